@@ -0,0 +1,344 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simulation.h"
+#include "scheduler.h"
+#include "emitter.h"
+#include "workers.h"
+
+// Headless benchmark: canonical scenarios stepped flat out on this thread,
+// reported as JSON and compared against a baseline from an earlier run.
+
+#define MAX_SCENARIOS 16
+#define MAX_LINE 1024
+#define SEED 1234u // Every run places the same particles
+#define REPEATS 3   // Runs of every scenario, by default
+
+typedef enum {
+    SETUP_GAS,       // Spread over the container with random velocities
+    SETUP_PILE,      // Lower half of the container, settled during warm-up
+    SETUP_RED_CLOUD, // RED only, so every pair feels interactionForce
+} ScenarioSetup;
+
+typedef struct {
+    char name[32];
+    ScenarioSetup setup;
+    int particles;
+    bool attractor; // G held every step
+    int warmup;
+    int steps;
+} Scenario;
+
+// Per-step medians, from the fastest of the repeated runs: a run can only
+// be slowed down by noise, never sped up by it
+typedef struct {
+    int particles; // Placed, which the container may cap below the request
+    double phaseNs[SIM_PHASES]; // Per particle per substep
+    double totalNs;
+    double throughput;          // Particle substeps per second
+    double p50, p90, p99, max;  // Step milliseconds over every run
+    double noise;               // Percent between the fastest and slowest run
+} Result;
+
+typedef struct {
+    const char* output;
+    const char* baseline;
+    double threshold; // Percent slower than the baseline that counts as a regression
+    int repeats;      // Runs of every scenario
+    const char* only;
+} Options;
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, int n, double p)
+{
+    int index = (int)(p * (n - 1) + 0.5);
+    return sorted[index];
+}
+
+// Sorts values in place
+static double median(double* values, int n)
+{
+    qsort(values, n, sizeof(double), compareDoubles);
+    return n % 2 ? values[n / 2] : 0.5 * (values[n / 2 - 1] + values[n / 2]);
+}
+
+static void setupScenario(Simulation* sim, const Scenario* scenario)
+{
+    FillVolume volume = { .shape = FILL_SPHERE, .radius = CONTAINER_RADIUS, .species = FILL_MIXED, .count = scenario->particles };
+    if (scenario->setup == SETUP_PILE) {
+        volume.shape = FILL_BOX;
+        vec3(volume.min, -CONTAINER_RADIUS, -CONTAINER_RADIUS, -CONTAINER_RADIUS);
+        vec3(volume.max, CONTAINER_RADIUS, 0.0f, CONTAINER_RADIUS);
+    } else if (scenario->setup == SETUP_RED_CLOUD) {
+        volume.radius = CONTAINER_RADIUS * 0.6f;
+        volume.species = RED;
+    }
+    fillVolume(sim->store, &volume, sim->containerPosition, SEED);
+
+    if (scenario->setup == SETUP_GAS) {
+        // Verlet velocity is the distance covered per substep
+        srand(SEED);
+        for (int i = 0; i < sim->store->count; i++) {
+            VerletObject* obj = &sim->store->objects[i];
+            for (int a = 0; a < 3; a++) {
+                obj->previous[a] = obj->current[a] - 0.01f * (rand() / (float)RAND_MAX - 0.5f);
+            }
+        }
+    }
+}
+
+// One fresh run from the same start; per-step times go to stepMs and phaseMs
+static int runOnce(const Scenario* scenario, double* stepMs, double (*phaseMs)[SIM_PHASES])
+{
+    Simulation* sim = createSimulation(scenario->particles);
+    setupScenario(sim, scenario);
+    int particles = sim->store->count;
+
+    if (scenario->attractor) {
+        // Held from the first step on, as the app does while G is down
+        SimCommand attract = { .type = SIM_ATTRACT, .position = { 0, 3, 0 }, .strength = -30.0f * SIM_SUBSTEPS };
+        pushCommand(sim, &attract);
+    }
+    for (int s = 0; s < scenario->warmup + scenario->steps; s++) {
+        double start = monotonicTime();
+        advanceSimulation(sim);
+        double elapsed = (monotonicTime() - start) * 1000.0;
+        if (s < scenario->warmup) {
+            continue;
+        }
+        const SimSnapshot* snapshot = &sim->snapshots[sim->latest];
+        for (int p = 0; p < SIM_PHASES; p++) {
+            phaseMs[s - scenario->warmup][p] = snapshot->phaseMs[p];
+        }
+        stepMs[s - scenario->warmup] = elapsed;
+    }
+    destroySimulation(sim);
+    return particles;
+}
+
+static void runScenario(const Scenario* scenario, int repeats, Result* result)
+{
+    int steps = scenario->steps;
+    double* allSteps = malloc(sizeof(double) * steps * repeats);
+    double* values = malloc(sizeof(double) * steps);
+    double (*phaseMs)[SIM_PHASES] = malloc(sizeof(double) * SIM_PHASES * steps);
+    double slowest = 0.0;
+
+    for (int r = 0; r < repeats; r++) {
+        double* stepMs = &allSteps[r * steps];
+        result->particles = runOnce(scenario, stepMs, phaseMs);
+        double scale = result->particles > 0 ? 1e6 / ((double)result->particles * SIM_SUBSTEPS) : 0.0;
+
+        memcpy(values, stepMs, sizeof(double) * steps);
+        double totalNs = median(values, steps) * scale;
+        slowest = fmax(slowest, totalNs);
+        if (r > 0 && totalNs >= result->totalNs) {
+            continue;
+        }
+        result->totalNs = totalNs;
+        for (int p = 0; p < SIM_PHASES; p++) {
+            for (int s = 0; s < steps; s++) {
+                values[s] = phaseMs[s][p];
+            }
+            result->phaseNs[p] = median(values, steps) * scale;
+        }
+    }
+    result->noise = result->totalNs > 0 ? 100.0 * (slowest / result->totalNs - 1.0) : 0.0;
+    result->throughput = result->totalNs > 0 ? 1e9 / result->totalNs : 0.0;
+
+    int n = steps * repeats;
+    qsort(allSteps, n, sizeof(double), compareDoubles);
+    result->p50 = percentile(allSteps, n, 0.50);
+    result->p90 = percentile(allSteps, n, 0.90);
+    result->p99 = percentile(allSteps, n, 0.99);
+    result->max = allSteps[n - 1];
+
+    free(allSteps);
+    free(values);
+    free(phaseMs);
+}
+
+// One scenario per line so a baseline can be read back a line at a time
+static void writeResult(FILE* fp, const Scenario* scenario, const Result* result, bool last)
+{
+    fprintf(fp, "    {\"name\": \"%s\", \"particles\": %d, \"steps\": %d, \"substeps\": %d, \"phases\": {",
+        scenario->name, result->particles, scenario->steps, SIM_SUBSTEPS);
+    for (int p = 0; p < SIM_PHASES; p++) {
+        fprintf(fp, "%s\"%s\": %.3f", p ? ", " : "", simPhaseNames[p], result->phaseNs[p]);
+    }
+    fprintf(fp, "}, \"ns_per_particle_substep\": %.3f, \"noise_pct\": %.2f, \"particle_substeps_per_s\": %.0f, "
+                "\"step_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}%s\n",
+        result->totalNs, result->noise, result->throughput, result->p50, result->p90, result->p99, result->max,
+        last ? "" : ",");
+}
+
+static bool readNumber(const char* line, const char* key, double* value)
+{
+    char quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"%s\":", key);
+    const char* at = strstr(line, quoted);
+    return at && sscanf(at + strlen(quoted), "%lf", value) == 1;
+}
+
+// Baseline numbers for the scenario, from a file this program wrote
+static bool readBaseline(const char* path, const char* name, Result* baseline)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    char line[MAX_LINE], quoted[64];
+    snprintf(quoted, sizeof(quoted), "\"name\": \"%s\"", name);
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), fp)) {
+        if (strstr(line, quoted) == NULL) {
+            continue;
+        }
+        found = readNumber(line, "ns_per_particle_substep", &baseline->totalNs);
+        if (!readNumber(line, "noise_pct", &baseline->noise)) {
+            baseline->noise = 0.0;
+        }
+        for (int p = 0; p < SIM_PHASES && found; p++) {
+            found = readNumber(line, simPhaseNames[p], &baseline->phaseNs[p]);
+        }
+    }
+    fclose(fp);
+    return found;
+}
+
+// Prints every regression past the threshold and returns how many there were.
+// A change only counts when it is also larger than the spread the two runs
+// measured between their own repeats. Phases under a tenth of the step are
+// too noisy to judge on their own.
+static int compareBaseline(const Options* options, const Scenario* scenario, const Result* result)
+{
+    Result baseline;
+    if (!readBaseline(options->baseline, scenario->name, &baseline)) {
+        printf("%-14s no baseline\n", scenario->name);
+        return 0;
+    }
+    double threshold = fmax(options->threshold, baseline.noise + result->noise);
+    double change = 100.0 * (result->totalNs / baseline.totalNs - 1.0);
+    int regressions = change > threshold;
+    printf("%-14s %9.1f ns/particle/substep  %+6.1f%% (limit %.1f%%)%s\n", scenario->name, result->totalNs, change,
+        threshold, regressions ? "  REGRESSION" : "");
+    for (int p = 0; p < SIM_PHASES; p++) {
+        if (baseline.phaseNs[p] < 0.1 * baseline.totalNs) {
+            continue;
+        }
+        double phaseChange = 100.0 * (result->phaseNs[p] / baseline.phaseNs[p] - 1.0);
+        if (phaseChange > threshold) {
+            printf("%14s %-12s %9.1f ns  %+6.1f%%  REGRESSION\n", "", simPhaseNames[p], result->phaseNs[p], phaseChange);
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static bool parseOptions(int argc, char** argv, Options* options, Scenario* scenarios, int* numScenarios)
+{
+    options->output = NULL;
+    options->baseline = NULL;
+    options->threshold = 10.0;
+    options->repeats = REPEATS;
+    options->only = NULL;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            options->output = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && hasValue) {
+            options->baseline = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && hasValue) {
+            options->threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--repeat") == 0 && hasValue) {
+            options->repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--only") == 0 && hasValue) {
+            options->only = argv[++i];
+        } else if (strcmp(argv[i], "--scale") == 0 && hasValue && *numScenarios < MAX_SCENARIOS) {
+            int particles = atoi(argv[++i]);
+            Scenario* scale = &scenarios[(*numScenarios)++];
+            *scale = (Scenario) { .setup = SETUP_GAS, .particles = particles, .warmup = 1, .steps = 3 };
+            snprintf(scale->name, sizeof(scale->name), "scale-%d", particles);
+        } else {
+            printf("Usage: %s [--output FILE] [--baseline FILE] [--threshold PERCENT] [--repeat N] [--only NAME] [--scale N]...\n",
+                argv[0]);
+            return false;
+        }
+    }
+    if (options->repeats < 1) {
+        printf("Need at least one --repeat\n");
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    // applyForces visits every pair, so the sizes stay where a run takes minutes, not hours
+    Scenario scenarios[MAX_SCENARIOS] = {
+        { "gas", SETUP_GAS, 1000, false, 5, 20 },
+        { "pile", SETUP_PILE, 2000, false, 20, 10 },
+        { "implosion", SETUP_GAS, 1000, true, 5, 20 },
+        { "red-cloud", SETUP_RED_CLOUD, 1000, false, 5, 20 },
+        { "scale-1000", SETUP_GAS, 1000, false, 2, 12 },
+        { "scale-2500", SETUP_GAS, 2500, false, 2, 6 },
+        { "scale-5000", SETUP_GAS, 5000, false, 1, 3 },
+    };
+    int numScenarios = 7;
+    Options options;
+    if (!parseOptions(argc, argv, &options, scenarios, &numScenarios)) {
+        return 2;
+    }
+
+    FILE* fp = stdout;
+    if (options.output) {
+        fp = fopen(options.output, "w");
+        if (fp == NULL) {
+            printf("Couldn't open file %s\n", options.output);
+            return 2;
+        }
+    }
+
+    Result results[MAX_SCENARIOS];
+    int selected[MAX_SCENARIOS];
+    int numSelected = 0;
+    for (int s = 0; s < numScenarios; s++) {
+        if (options.only == NULL || strcmp(options.only, scenarios[s].name) == 0) {
+            selected[numSelected++] = s;
+        }
+    }
+    fprintf(fp, "{\n  \"threads\": %d,\n  \"substeps\": %d,\n  \"scenarios\": [\n", THREAD_COUNT, SIM_SUBSTEPS);
+    int regressions = 0;
+    for (int i = 0; i < numSelected; i++) {
+        const Scenario* scenario = &scenarios[selected[i]];
+        runScenario(scenario, options.repeats, &results[i]);
+        writeResult(fp, scenario, &results[i], i == numSelected - 1);
+        fflush(fp);
+        if (options.baseline) {
+            regressions += compareBaseline(&options, scenario, &results[i]);
+        } else if (fp != stdout) {
+            printf("%-14s %9.1f ns/particle/substep  noise %.1f%%  p50 %.2f ms  p99 %.2f ms\n", scenario->name,
+                results[i].totalNs, results[i].noise, results[i].p50, results[i].p99);
+        }
+    }
+    fprintf(fp, "  ]\n}\n");
+    if (fp != stdout) {
+        fclose(fp);
+    }
+    stopWorkers();
+
+    if (regressions > 0) {
+        printf("%d regressions\n", regressions);
+        return 1;
+    }
+    return 0;
+}
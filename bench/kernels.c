@@ -0,0 +1,458 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instances.h"
+#include "scheduler.h"
+#include "simulation.h"
+#include "verlet.h"
+#include "workers.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Microbenchmarks: each step kernel on its own, fed synthetic particles at a
+// controlled number per grid cell, so a change can be judged kernel by kernel.
+
+#define MAX_REPS 1000
+#define MAX_DENSITIES 8
+#define SEED 1234u
+#define SETTLE_SPEED 0.002f // Distance per substep given to every particle
+
+typedef enum {
+    DIST_UNIFORM,   // Random in a sphere sized for the density
+    DIST_CLUSTERED, // Gaussian blobs, so a few cells hold most particles
+    DIST_LATTICE,   // Cubic lattice filled outwards from the centre
+    DISTRIBUTIONS
+} Distribution;
+
+static const char* distributionNames[DISTRIBUTIONS] = { "uniform", "clustered", "lattice" };
+
+typedef struct {
+    int count;
+    VerletObject* objects;
+    VerletObject* pristine; // Input every repetition starts from
+    mfloat_t* origins;      // Positions a substep earlier, for packing
+    InstanceData* instances;
+    PackView view;
+    mfloat_t container[VEC3_SIZE];
+} Input;
+
+typedef struct {
+    const char* name;
+    void (*prepare)(Input* input); // Untimed, before every repetition
+    void (*run)(Input* input);
+} Kernel;
+
+typedef struct {
+    double min, median, mean, stddev; // Nanoseconds per call
+    double occupancy;                 // Mean particles per occupied cell
+    int maxOccupancy;
+} Stats;
+
+typedef struct {
+    int particles;
+    double densities[MAX_DENSITIES];
+    int numDensities;
+    int warmup;
+    int reps;
+    const char* kernel;
+    const char* distribution;
+    const char* output;
+    double ghz; // 0 to calibrate against the TSC or ask the OS
+} Options;
+
+static uint32_t rngState = SEED;
+
+static float randomUnit()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return (rngState >> 8) * (1.0f / 16777216.0f);
+}
+
+static float randomGaussian()
+{
+    float u = fmaxf(randomUnit(), 1e-7f), v = randomUnit();
+    return sqrtf(-2.0f * logf(u)) * cosf(2.0f * MPI * v);
+}
+
+static void randomInSphere(mfloat_t* point, mfloat_t radius)
+{
+    do {
+        for (int a = 0; a < 3; a++) {
+            point[a] = (2.0f * randomUnit() - 1.0f) * radius;
+        }
+    } while (vec3_length(point) > radius);
+}
+
+static int compareDistance(const void* a, const void* b)
+{
+    mfloat_t x = vec3_length((mfloat_t*)a), y = vec3_length((mfloat_t*)b);
+    return (x > y) - (x < y);
+}
+
+// Positions for count particles averaging density per cell. Returns how many
+// fit inside the container.
+static int placeParticles(mfloat_t* points, int count, Distribution distribution, double density)
+{
+    const mfloat_t limit = CONTAINER_RADIUS - VERLET_RADIUS;
+    mfloat_t cellVolume = GRID_CELL * GRID_CELL * GRID_CELL;
+    mfloat_t radius = fminf(cbrtf(3.0f * count * cellVolume / (4.0f * MPI * density)), limit);
+    rngState = SEED;
+
+    if (distribution == DIST_UNIFORM) {
+        for (int i = 0; i < count; i++) {
+            randomInSphere(&points[i * VEC3_SIZE], radius);
+        }
+        return count;
+    }
+    if (distribution == DIST_CLUSTERED) {
+        enum { CLUSTERS = 8 };
+        mfloat_t centers[CLUSTERS][VEC3_SIZE];
+        for (int c = 0; c < CLUSTERS; c++) {
+            randomInSphere(centers[c], radius * 0.6f);
+        }
+        for (int i = 0; i < count; i++) {
+            mfloat_t* point = &points[i * VEC3_SIZE];
+            for (int a = 0; a < 3; a++) {
+                point[a] = centers[i % CLUSTERS][a] + randomGaussian() * radius * 0.1f;
+            }
+            mfloat_t length = vec3_length(point);
+            if (length > limit) {
+                vec3_multiply_f(point, point, limit / length);
+            }
+        }
+        return count;
+    }
+
+    // Every lattice point in the container, nearest the centre first
+    mfloat_t spacing = GRID_CELL / cbrtf(density);
+    int side = (int)(2.0f * limit / spacing) + 1;
+    mfloat_t* lattice = malloc(sizeof(mfloat_t) * VEC3_SIZE * side * side * side);
+    int sites = 0;
+    for (int x = 0; x < side; x++) {
+        for (int y = 0; y < side; y++) {
+            for (int z = 0; z < side; z++) {
+                mfloat_t* point = &lattice[sites * VEC3_SIZE];
+                vec3(point, -limit + x * spacing, -limit + y * spacing, -limit + z * spacing);
+                sites += vec3_length(point) <= limit;
+            }
+        }
+    }
+    qsort(lattice, sites, sizeof(mfloat_t) * VEC3_SIZE, compareDistance);
+    int placed = count < sites ? count : sites;
+    memcpy(points, lattice, sizeof(mfloat_t) * VEC3_SIZE * placed);
+    free(lattice);
+    return placed;
+}
+
+static void createInput(Input* input, int count, Distribution distribution, double density)
+{
+    static const ParticleColor mixed[] = { RED, GREEN, BLUE };
+    mfloat_t* points = malloc(sizeof(mfloat_t) * VEC3_SIZE * count);
+    input->count = placeParticles(points, count, distribution, density);
+    input->objects = malloc(sizeof(VerletObject) * input->count);
+    input->pristine = malloc(sizeof(VerletObject) * input->count);
+    input->origins = malloc(sizeof(mfloat_t) * VEC3_SIZE * input->count);
+    input->instances = malloc(sizeof(InstanceData) * input->count);
+    vec3_zero(input->container);
+
+    for (int i = 0; i < input->count; i++) {
+        VerletObject* obj = &input->pristine[i];
+        memset(obj, 0, sizeof(VerletObject));
+        vec3_assign(obj->current, &points[i * VEC3_SIZE]);
+        for (int a = 0; a < 3; a++) {
+            obj->previous[a] = obj->current[a] - (2.0f * randomUnit() - 1.0f) * SETTLE_SPEED;
+        }
+        obj->radius = VERLET_RADIUS;
+        obj->color = mixed[i % 3];
+        setColorVector(obj);
+        setMassFromColor(obj);
+        vec3_assign(&input->origins[i * VEC3_SIZE], obj->previous);
+    }
+    memcpy(input->objects, input->pristine, sizeof(VerletObject) * input->count);
+    free(points);
+
+    // The app's default camera, looking at the whole container
+    mfloat_t projection[MAT4_SIZE], view[MAT4_SIZE];
+    mfloat_t eye[VEC3_SIZE] = { 0, 0, 20 }, target[VEC3_SIZE] = { 0, 0, 0 }, up[VEC3_SIZE] = { 0, 1, 0 };
+    mat4_perspective(projection, to_radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    mat4_look_at(view, eye, target, up);
+    input->view = (PackView) { .frustumCull = true, .lodPixels = { 2.0f, 4.0f, 8.0f } };
+    updatePackView(&input->view, projection, view, eye, 1080);
+}
+
+static void destroyInput(Input* input)
+{
+    clearGrid();
+    free(input->objects);
+    free(input->pristine);
+    free(input->origins);
+    free(input->instances);
+}
+
+static void restore(Input* input)
+{
+    memcpy(input->objects, input->pristine, sizeof(VerletObject) * input->count);
+}
+
+static void prepareFilled(Input* input)
+{
+    restore(input);
+    clearGrid();
+    fillGrid(input->objects, input->count);
+}
+
+static void prepareEmpty(Input* input)
+{
+    restore(input);
+    clearGrid();
+}
+
+static void runClearGrid(Input* input)
+{
+    clearGrid();
+}
+
+static void runFillGrid(Input* input)
+{
+    fillGrid(input->objects, input->count);
+}
+
+static void runCollisions(Input* input)
+{
+    resolveGridCollisions();
+}
+
+static void runForces(Input* input)
+{
+    applyForces(input->objects, input->count);
+}
+
+static void runConstraints(Input* input)
+{
+    applyConstraints(input->objects, input->count, input->container);
+}
+
+static void runIntegration(Input* input)
+{
+    updatePositions(input->objects, input->count, SIM_STEP / SIM_SUBSTEPS);
+}
+
+static void runPacking(Input* input)
+{
+    PackResult result;
+    packInstances(input->objects, input->origins, 0.5f, input->count, &input->view, input->instances, &result);
+}
+
+static const Kernel kernels[] = {
+    { "clearGrid", prepareFilled, runClearGrid },
+    { "fillGrid", prepareEmpty, runFillGrid },
+    { "collisions", prepareFilled, runCollisions },
+    { "forces", prepareEmpty, runForces },
+    { "constraints", prepareEmpty, runConstraints },
+    { "integration", prepareEmpty, runIntegration },
+    { "packing", prepareEmpty, runPacking },
+};
+#define NUM_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Particles per occupied cell of the input, as fillGrid sees it
+static void measureOccupancy(Input* input, Stats* stats)
+{
+    prepareFilled(input);
+    int occupied = 0;
+    stats->maxOccupancy = 0;
+    for (int x = 0; x < DIMENSION; x++) {
+        for (int y = 0; y < DIMENSION; y++) {
+            for (int z = 0; z < DIMENSION; z++) {
+                int n = 0;
+                for (Node* node = grid[x][y][z]; node; node = node->next) {
+                    n++;
+                }
+                occupied += n > 0;
+                stats->maxOccupancy = n > stats->maxOccupancy ? n : stats->maxOccupancy;
+            }
+        }
+    }
+    stats->occupancy = occupied ? (double)input->count / occupied : 0.0;
+    clearGrid();
+}
+
+static void measure(const Kernel* kernel, Input* input, const Options* options, Stats* stats)
+{
+    double samples[MAX_REPS];
+    for (int r = 0; r < options->warmup + options->reps; r++) {
+        kernel->prepare(input);
+        double start = monotonicTime();
+        kernel->run(input);
+        double elapsed = (monotonicTime() - start) * 1e9;
+        if (r >= options->warmup) {
+            samples[r - options->warmup] = elapsed;
+        }
+    }
+
+    int n = options->reps;
+    qsort(samples, n, sizeof(double), compareDoubles);
+    double sum = 0.0, squares = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += samples[i];
+    }
+    stats->mean = sum / n;
+    for (int i = 0; i < n; i++) {
+        squares += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+    }
+    stats->min = samples[0];
+    stats->median = n % 2 ? samples[n / 2] : 0.5 * (samples[n / 2 - 1] + samples[n / 2]);
+    stats->stddev = n > 1 ? sqrt(squares / (n - 1)) : 0.0;
+}
+
+// Cycles per nanosecond: --ghz, else the TSC rate, else the rated clock
+// Linux reports through cpufreq; 0 when nothing knows
+static double cycleRate(const Options* options)
+{
+    if (options->ghz > 0.0) {
+        return options->ghz;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    double start = monotonicTime();
+    uint64_t ticks = __rdtsc();
+    while (monotonicTime() - start < 0.05) {
+    }
+    return (__rdtsc() - ticks) / ((monotonicTime() - start) * 1e9);
+#else
+    double kHz = 0.0;
+    FILE* fp = fopen("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq", "r");
+    if (fp) {
+        if (fscanf(fp, "%lf", &kHz) != 1) {
+            kHz = 0.0;
+        }
+        fclose(fp);
+    }
+    return kHz * 1e-6;
+#endif
+}
+
+static bool parseOptions(int argc, char** argv, Options* options)
+{
+    *options = (Options) { .particles = 4000, .densities = { 0.25, 1.0 }, .numDensities = 2, .warmup = 3, .reps = 15 };
+    bool densityGiven = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--particles") == 0 && hasValue) {
+            options->particles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--density") == 0 && hasValue) {
+            // Repeat for several; the first replaces the defaults
+            if (!densityGiven) {
+                options->numDensities = 0;
+                densityGiven = true;
+            }
+            if (options->numDensities < MAX_DENSITIES) {
+                options->densities[options->numDensities++] = atof(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--warmup") == 0 && hasValue) {
+            options->warmup = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && hasValue) {
+            options->reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kernel") == 0 && hasValue) {
+            options->kernel = argv[++i];
+        } else if (strcmp(argv[i], "--distribution") == 0 && hasValue) {
+            options->distribution = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            options->output = argv[++i];
+        } else if (strcmp(argv[i], "--ghz") == 0 && hasValue) {
+            options->ghz = atof(argv[++i]);
+        } else {
+            printf("Usage: %s [--particles N] [--density PER_CELL]... [--warmup N] [--reps N] [--kernel NAME]\n"
+                   "       [--distribution uniform|clustered|lattice] [--output FILE] [--ghz F]\n", argv[0]);
+            return false;
+        }
+    }
+    if (options->particles <= 0 || options->reps <= 0 || options->reps > MAX_REPS || options->warmup < 0) {
+        printf("Need a positive particle count and 1 to %d repetitions\n", MAX_REPS);
+        return false;
+    }
+    for (int d = 0; d < options->numDensities; d++) {
+        if (options->densities[d] <= 0.0) {
+            printf("Density must be positive\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        return 2;
+    }
+    double rate = cycleRate(&options);
+    if (rate <= 0.0) {
+        printf("Couldn't find the CPU clock rate, pass it with --ghz\n");
+        return 2;
+    }
+    FILE* fp = NULL;
+    if (options.output) {
+        fp = fopen(options.output, "w");
+        if (fp == NULL) {
+            printf("Couldn't open file %s\n", options.output);
+            return 2;
+        }
+        fprintf(fp, "{\n  \"threads\": %d,\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"kernels\": [\n",
+            THREAD_COUNT, options.warmup, options.reps);
+    }
+
+    printf("%-12s %-10s %7s %9s %5s %11s %11s %11s %11s %9s\n", "kernel", "input", "density", "particles",
+        "occ", "min us", "median us", "stddev us", "ns/particle", "cycles/p");
+    bool first = true;
+    for (int d = 0; d < DISTRIBUTIONS; d++) {
+        if (options.distribution && strcmp(options.distribution, distributionNames[d]) != 0) {
+            continue;
+        }
+        for (int k = 0; k < options.numDensities; k++) {
+            Input input;
+            createInput(&input, options.particles, d, options.densities[k]);
+            Stats stats;
+            measureOccupancy(&input, &stats);
+            for (int n = 0; n < NUM_KERNELS; n++) {
+                const Kernel* kernel = &kernels[n];
+                if (options.kernel && strcmp(options.kernel, kernel->name) != 0) {
+                    continue;
+                }
+                measure(kernel, &input, &options, &stats);
+                double perParticle = stats.median / input.count;
+                printf("%-12s %-10s %7.2f %9d %5.2f %11.1f %11.1f %11.1f %11.2f %9.1f\n", kernel->name,
+                    distributionNames[d], options.densities[k], input.count, stats.occupancy, stats.min / 1e3,
+                    stats.median / 1e3, stats.stddev / 1e3, perParticle, perParticle * rate);
+                if (fp) {
+                    fprintf(fp, "%s    {\"kernel\": \"%s\", \"distribution\": \"%s\", \"density\": %.3f, \"particles\": %d, "
+                                "\"occupancy\": %.3f, \"max_occupancy\": %d, \"min_ns\": %.0f, \"median_ns\": %.0f, "
+                                "\"mean_ns\": %.0f, \"stddev_ns\": %.0f, \"ns_per_particle\": %.3f, \"cycles_per_particle\": %.2f}",
+                        first ? "" : ",\n", kernel->name, distributionNames[d], options.densities[k], input.count,
+                        stats.occupancy, stats.maxOccupancy, stats.min, stats.median, stats.mean, stats.stddev,
+                        perParticle, perParticle * rate);
+                    first = false;
+                }
+            }
+            destroyInput(&input);
+        }
+    }
+    if (fp) {
+        fprintf(fp, "\n  ]\n}\n");
+        fclose(fp);
+    }
+    stopWorkers();
+    return 0;
+}
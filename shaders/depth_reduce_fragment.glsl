@@ -0,0 +1,20 @@
+#version 330 core
+
+uniform sampler2D depthTexture;
+
+out float maxDepth;
+
+// Farthest depth of the BLOCK_SIZE x BLOCK_SIZE pixels this texel covers
+void main()
+{
+    ivec2 size = textureSize(depthTexture, 0);
+    ivec2 origin = ivec2(gl_FragCoord.xy) * BLOCK_SIZE;
+    float result = 0.0;
+    for (int y = 0; y < BLOCK_SIZE; y++) {
+        for (int x = 0; x < BLOCK_SIZE; x++) {
+            ivec2 texel = min(origin + ivec2(x, y), size - 1);
+            result = max(result, texelFetch(depthTexture, texel, 0).r);
+        }
+    }
+    maxDepth = result;
+}
@@ -0,0 +1,48 @@
+#version 330 core
+
+in vec3 fragmentViewPos;
+flat in vec3 fragmentCenter;
+flat in float fragmentRadius;
+flat in float fragmentVelocity;
+flat in vec3 fragmentColor;
+
+out vec4 color;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+
+void main()
+{
+    // Ray from the eye (view space origin) through this fragment
+    vec3 dir = normalize(fragmentViewPos);
+    float b = dot(dir, fragmentCenter);
+    float c = dot(fragmentCenter, fragmentCenter) - fragmentRadius * fragmentRadius;
+    float disc = b * b - c;
+    if (disc < 0.0) {
+        discard;
+    }
+    vec3 hit = dir * (b - sqrt(disc));
+    vec3 norm = (hit - fragmentCenter) / fragmentRadius;
+
+    vec4 clip = projection * vec4(hit, 1.0);
+    gl_FragDepth = (clip.z / clip.w) * 0.5 + 0.5;
+
+    // Same lighting as the INSTANCED path of phong_fragment.glsl, evaluated in view space
+    vec3 lightColor = vec3(1.0, 1.0, 1.0);
+    vec3 lightPos = vec3(view * vec4(10.0, 10.0, 10.0, 1.0));
+
+    // ambient
+    float ambientStrength = 0.3;
+    vec3 ambient = ambientStrength * lightColor;
+
+    // diffuse
+    vec3 lightDir = normalize(lightPos - hit);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+
+    vec3 result = (ambient + diffuse) * fragmentColor;
+
+    color = vec4(result, 1.0);
+}
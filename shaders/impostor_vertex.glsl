@@ -0,0 +1,37 @@
+#version 330 core
+
+layout (location = 0) in vec3 vertexPos;
+layout (location = 3) in vec3 instancePosition;
+layout (location = 4) in float instanceVelocity;
+layout (location = 5) in vec3 instanceColor;
+layout (location = 6) in float instanceRadius;
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+
+out vec3 fragmentViewPos;
+flat out vec3 fragmentCenter;
+flat out float fragmentRadius;
+flat out float fragmentVelocity;
+flat out vec3 fragmentColor;
+
+void main()
+{
+    vec3 center = vec3(view * vec4(instancePosition, 1.0));
+    float depth = max(-center.z, instanceRadius * 1.001);
+
+    // Half-size of a view-aligned quad through the center that covers the
+    // sphere's perspective silhouette, including off-axis stretching
+    float extent = instanceRadius * (length(center.xy) + depth) / (depth - instanceRadius);
+    extent = min(extent, depth * 4.0);
+
+    fragmentViewPos = center + vec3(vertexPos.xy * extent, 0.0);
+    fragmentCenter = center;
+    fragmentRadius = instanceRadius;
+    fragmentVelocity = instanceVelocity;
+    fragmentColor = instanceColor;
+
+    gl_Position = projection * vec4(fragmentViewPos, 1.0);
+}
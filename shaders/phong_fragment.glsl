@@ -3,6 +3,10 @@
 in vec3 fragmentPos;
 in vec3 fragmentVertexNormal;
 in vec2 fragmentTexCoord;
+#ifdef INSTANCED
+in float fragmentVelocity;
+in vec3 fragmentColor;
+#endif
 
 out vec4 color;
 
@@ -12,7 +16,11 @@ void main()
 {
     vec3 lightColor = vec3(1.0, 1.0, 1.0);
     vec3 lightPos = vec3(10.0, 10.0, 10.0);
+#ifdef INSTANCED
+    vec3 objectColor = fragmentColor;
+#else
     vec3 objectColor = vec3(0.6, 0.3, 0.7);
+#endif
 
     // ambient
     float ambientStrength = 0.3;
@@ -29,4 +37,4 @@ void main()
 
     color = vec4(result, 1.0);
     // color = texture(imageTexture, fragmentTexCoord);
-}
\ No newline at end of file
+}
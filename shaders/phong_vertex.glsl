@@ -3,20 +3,43 @@
 layout (location = 0) in vec3 vertexPos;
 layout (location = 1) in vec3 vertexNormal;
 layout (location = 2) in vec2 vertexTexCoord;
+#ifdef INSTANCED
+layout (location = 3) in vec3 instancePosition;
+layout (location = 4) in float instanceVelocity;
+layout (location = 5) in vec3 instanceColor;
+layout (location = 6) in float instanceRadius;
+#endif
 
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+};
+
+#ifndef INSTANCED
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#endif
 
 out vec3 fragmentPos;
 out vec3 fragmentVertexNormal;
 out vec2 fragmentTexCoord;
+#ifdef INSTANCED
+out float fragmentVelocity;
+out vec3 fragmentColor;
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    // Uniform scale plus translation, the normal passes through unchanged
+    fragmentPos = instancePosition + vertexPos * instanceRadius;
+    fragmentVertexNormal = vertexNormal;
+    fragmentVelocity = instanceVelocity;
+    fragmentColor = instanceColor;
+#else
     fragmentPos = vec3(model * vec4(vertexPos, 1.0));
     fragmentVertexNormal = mat3(transpose(inverse(model))) * vertexNormal;
+#endif
     fragmentTexCoord = vertexTexCoord;
 
     gl_Position = projection * view * vec4(fragmentPos, 1.0);
-}
\ No newline at end of file
+}
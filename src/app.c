@@ -1,3 +1,5 @@
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -14,22 +16,63 @@
 #include "camera.h"
 #include "model.h"
 #include "verlet.h"
+#include "particles.h"
+#include "stream.h"
+#include "instances.h"
+#include "depthcapture.h"
+#include "workers.h"
+#include "simulation.h"
+#include "scheduler.h"
+#include "headless.h"
+#include "framedump.h"
+#include "playback.h"
+#include "inputlog.h"
+#include "scene.h"
+#include "profiler.h"
 #include "hud.h"
 
 // Preprocessor constants
 #define ANIMATION_TIME 90.0f // Frames
 #define ADDITION_SPEED 10
 #define TARGET_FPS 60
-#define NUM_SUBSTEPS 8
 #define MAX_SPAWNS_PER_FRAME 1 // Limit how many particles can be spawned per render frame
+#define AUTO_SPAWN_LIFETIME 120.0f // Seconds an auto-spawned ball lives before being recycled
+#define DRAIN_RADIUS 1.0f
+#define SNAPSHOT_FILE "scene.snap" // Written by F5, read back by F9
+
+// Command line options
+typedef struct {
+    bool headless;
+    int frames;        // Frames to render when headless
+    const char* output; // PPM directory, or "-" for raw RGB24 on stdout
+    int width;
+    int height;
+    int particles;     // Ring particles fed in while headless
+    const char* load;  // Snapshot restored before the first step, or NULL
+    const char* record; // Trajectory file every step is appended to, or NULL
+    const char* play;   // Trajectory shown instead of running the simulation, or NULL
+    const char* exportDirectory; // Per-step files for external tools go here, or NULL
+    ExportFormat exportFormat;
+    int exportEvery;
+    const char* logInput; // Input log written for a later --replay, or NULL
+    const char* replay;   // Input log rerun step for step before live input, or NULL
+    const char* scene;    // Scene file setting up the container, particles, emitters and fields, or NULL
+    int traceFrames;      // Frames in a trace capture (F8 or the Profiler window)
+} Options;
 
 // Function prototypes
+bool parseOptions(int argc, char** argv, Options* options);
+bool parseInt(const char* text, int* value);
+bool keyDown(GLFWwindow* window, int key);
+bool keyPressed(GLFWwindow* window, int key, bool* held);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void cursor_enter_callback(GLFWwindow* window, int entered);
 void processInput(GLFWwindow* window);
 void updateCamera(GLFWwindow* window, Mouse* mouse, Camera* camera);
+void updatePicking(GLFWwindow* window, Simulation* sim, Camera* camera);
+void rejectSimulationKeys(GLFWwindow* window, bool clearFromHUD);
 void instantiateVerlets(VerletObject* objects, int size);
-void spawnVerlet(VerletObject* objects, int* numActive, int maxInstances, mfloat_t* position, mfloat_t* velocity, ParticleColor color, mfloat_t radius);
+void queueSpawn(Simulation* sim, mfloat_t* position, ParticleColor color, mfloat_t lifetime);
 
 // Settings
 const unsigned int SCR_WIDTH = 1280;
@@ -42,6 +85,8 @@ float cameraRadius = 24.0f;
 int totalFrames = 0;
 // Enable/disable automatic orbiting of the camera
 bool autoOrbit = true;
+// Draw particles as ray-cast impostor quads instead of sphere meshes
+bool impostors = true;
 
 const char* vertexShaderSource = "#version 330 core\n"
     "layout (location = 0) in vec3 aPos;\n"
@@ -57,44 +102,60 @@ const char* fragmentShaderSource = "#version 330 core\n"
     "    FragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
     "}\0";
 
-int main() {
+int main(int argc, char** argv) {
     
-    GLFWwindow* window;
-    
-    // Initialize GLFW
-    if (!glfwInit()) {
-        return -1;  // Initialization failed
+    Options options;
+    if (!parseOptions(argc, argv, &options)) {
+        return -1;
     }
+    double startTime = monotonicTime();
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_DEPTH_BITS, 24);  // Ensure depth buffer is available
+    GLFWwindow* window = NULL;
+    HeadlessContext headlessContext;
 
-    #ifdef __APPLE__
-        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    #endif
-    
-    // Create a windowed mode window and its OpenGL context
-    window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Verlet Integration", NULL, NULL);
-    if (!window) {
-        glfwTerminate();
-        return -1;  // Window or OpenGL context creation failed
-    }
+    if (options.headless) {
+        // No window system at all; rendering goes to an offscreen framebuffer
+        if (!createHeadlessContext(&headlessContext)) {
+            return -1;
+        }
+    } else {
+        // Initialize GLFW
+        if (!glfwInit()) {
+            return -1;  // Initialization failed
+        }
 
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_DEPTH_BITS, 24);  // Ensure depth buffer is available
 
-    /* Set up a callback function for when the window is resized */
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSwapInterval(1);
-    
-    /* Callback function for mouse enter/exit */
-    glfwSetCursorEnterCallback(window, cursor_enter_callback);
+        #ifdef __APPLE__
+            glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        #endif
+
+        // Create a windowed mode window and its OpenGL context
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Verlet Integration", NULL, NULL);
+        if (!window) {
+            glfwTerminate();
+            return -1;  // Window or OpenGL context creation failed
+        }
+
+        // Make the window's context current
+        glfwMakeContextCurrent(window);
+
+        /* Set up a callback function for when the window is resized */
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSwapInterval(1);
+
+        /* Callback function for mouse enter/exit */
+        glfwSetCursorEnterCallback(window, cursor_enter_callback);
+    }
 
     // Initialize GLEW
     glewExperimental = GL_TRUE;  // Ensures GLEW uses more modern techniques for managing OpenGL functionality
-    if (glewInit() != GLEW_OK) {
+    GLenum glewStatus = glewInit();
+    // A GLX build of GLEW loads the GL entry points, then complains about the missing X display
+    if (glewStatus != GLEW_OK && !(options.headless && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY)) {
         return -1;  // GLEW initialization failed
     }
 
@@ -115,55 +176,170 @@ int main() {
     glPointSize(3.0);
 
     // Initialize HUD (Dear ImGui)
-    hud_init(window);
+    if (window) {
+        hud_init(window);
+    }
 
     /* Models & Shaders */
-    unsigned int phongShader = createShader("shaders/phong_vertex.glsl", "shaders/phong_fragment.glsl");
-    unsigned int instanceShader = createShader("shaders/instance_vertex.glsl", "shaders/instance_fragment.glsl");
-    unsigned int baseShader = createShader("shaders/base_vertex.glsl", "shaders/base_fragment.glsl");
-
-    Mesh* mesh = createMesh("models/sphere.obj", true);
+    ShaderProgram* phongShader = createShader("shaders/phong_vertex.glsl", "shaders/phong_fragment.glsl", NULL);
+    ShaderProgram* instanceShader = createShader("shaders/phong_vertex.glsl", "shaders/phong_fragment.glsl", "#define INSTANCED\n");
+    ShaderProgram* baseShader = createShader("shaders/base_vertex.glsl", "shaders/base_fragment.glsl", NULL);
+    ShaderProgram* impostorShader = createShader("shaders/impostor_vertex.glsl", "shaders/impostor_fragment.glsl", NULL);
+    // View and projection for every program above, refreshed once per frame
+    unsigned int cameraBuffer = createCameraBuffer();
+
+    // Particle level-of-detail chain, icosphere level l drawn for LOD l
+    Mesh* lodMeshes[NUM_LODS];
+    for (int l = 0; l < NUM_LODS; l++) {
+        lodMeshes[l] = createIcosphereMesh(l, true);
+    }
+    Mesh* impostorMesh = createImpostorMesh();
+    // The container gets its own VAO without the instance attributes
+    Mesh* containerMesh = createMesh("models/sphere.obj", false);
+    InstanceStream* instanceStream = createInstanceStream(MAX_INSTANCES);
     //Mesh* cubeMesh = createMesh("models/cube.obj", false);
     
     // Container
-    mfloat_t containerPosition[VEC3_SIZE] = { 0, 0, 0 };
     mfloat_t rotation[VEC3_SIZE] = { 0, 0, 0 };
     
-    VerletObject* verlets = malloc(sizeof(VerletObject) * MAX_INSTANCES);
-    //for (int i = 0; i < MAX_INSTANCES; ++i) {
-    //    verlets[i].visible = false;
-    //   }
-    instantiateVerlets(verlets, MAX_INSTANCES);
-    int numActive = 0;
+    // Physics runs on its own thread; this loop only sends commands and draws snapshots
+    Simulation* sim = createSimulation(MAX_INSTANCES);
+    if (options.load) {
+        SimCommand load = { .type = SIM_LOAD, .path = options.load };
+        pushCommand(sim, &load);
+    }
+    if (options.record) {
+        sim->recorder = createTrajectoryRecorder(options.record, MAX_INSTANCES);
+    }
+    if (options.exportDirectory) {
+        sim->exporter = createExporter(options.exportDirectory, options.exportFormat, options.exportEvery, MAX_INSTANCES);
+    }
+    // The seed goes into the input log so a replay draws the same numbers
+    uint32_t seed = (uint32_t)time(NULL);
+    if (options.replay) {
+        sim->replay = openInputLog(options.replay, &seed);
+        if (sim->replay == NULL) {
+            return -1;
+        }
+        printf("Replaying %lu steps from %s\n", sim->replay->endStep, options.replay);
+    }
+    if (options.logInput) {
+        sim->inputLog = createInputLog(options.logInput, seed);
+    }
+    Scene* scene = NULL;
+    if (options.scene) {
+        scene = loadScene(options.scene);
+        if (scene == NULL) {
+            return -1;
+        }
+        double start = monotonicTime();
+        int placed = applyScene(scene, sim->store, sim->containerPosition, seed);
+        printf("Placed %d particles from %s in %.2f ms\n", placed, options.scene, (monotonicTime() - start) * 1000.0);
+        sim->scene = scene;
+        // The scene stands in for the ring
+        options.particles = 0;
+    }
+    // A recorded trajectory stands in for the simulation entirely
+    Playback* playback = NULL;
+    if (options.play) {
+        playback = openPlayback(options.play);
+        if (playback == NULL) {
+            return -1;
+        }
+        printf("Playing %d frames from %s\n", playback->numFrames, options.play);
+    }
+    HudPlayback playbackControls = { .active = playback != NULL, .numFrames = playback ? playback->numFrames : 0 };
+    double playbackTime = 0.0;
+    FrameDump* frameDump = NULL;
+    if (options.headless) {
+        // Offline: stepped from this loop, one step per rendered frame
+        frameDump = createFrameDump(options.width, options.height, options.output);
+    } else if (!playback) {
+        startSimulation(sim);
+    }
+    // Ring layout handed out ADDITION_SPEED at a time by the 'V' key
+    VerletObject* ringVerlets = malloc(sizeof(VerletObject) * MAX_INSTANCES);
+    instantiateVerlets(ringVerlets, MAX_INSTANCES);
+    int nextRing = 0;
     
     mfloat_t view[MAT4_SIZE];
+    mfloat_t projection[MAT4_SIZE];
+    int fbWidth = options.width, fbHeight = options.height;
+    createProjectionMatrix(projection, (float)fbWidth / (float)fbHeight);
+    // Switch to the next icosphere level when the projected radius reaches 2, 4, 8 px
+    PackView packView = { .frustumCull = true, .lodPixels = { 2.0f, 4.0f, 8.0f } };
+    // Particles hidden behind the previous frame's particle depth are skipped
+    DepthCapture* depthCapture = createDepthCapture();
+    DepthPyramid depthPyramid;
+    initDepthPyramid(&depthPyramid);
+    packView.occlusion = &depthPyramid;
+    packView.occlusionCull = true;
     camera = createCamera((mfloat_t[]) { 0, 0, cameraRadius });
 
     Mouse* mouse = createMouse();
 
     float dt = 0.000001f;
-    float lastFrameTime = (float)glfwGetTime();
+    // Frame pacing; vsync still applies on top when the driver honours it
+    FrameScheduler frameScheduler;
+    initScheduler(&frameScheduler, 1.0 / TARGET_FPS, 2.0 / TARGET_FPS);
 
     char title[100] = "";
-
-    srand(time(NULL));
+    HudStats stats = { 0 };
+    ProfileReport profile = { 0 };
+    stats.profile = &profile;
 
     // Main loop
 
-    while (!glfwWindowShouldClose(window)) {
+    while (frameDump ? totalFrames < options.frames : !glfwWindowShouldClose(window)) {
         /* Input */
-        updateMouse(window, mouse);
-        processInput(window);
-        int visibleCount = 0; // Count only visible objects
+        if (window) {
+            updateMouse(window, mouse);
+            processInput(window);
+        }
+        PackResult packed;
+        mfloat_t alpha;
+        const SimSnapshot* snapshot;
+        if (playback) {
+            // One recorded step per SIM_STEP of display time
+            playbackControls.frame = (int)(playbackTime / SIM_STEP);
+            snapshot = seekPlayback(playback, playbackControls.frame);
+            alpha = frameDump ? 1.0f : (mfloat_t)(playbackTime / SIM_STEP - playbackControls.frame);
+        } else {
+            if (frameDump) {
+                // Feed the ring in as if 'V' were held, then take exactly one step
+                SimCommand insert = { .type = SIM_INSERT };
+                for (int i = 0; i < ADDITION_SPEED && nextRing < options.particles; i++) {
+                    insert.object = ringVerlets[nextRing++];
+                    pushCommand(sim, &insert);
+                }
+                advanceSimulation(sim);
+            }
+            snapshot = acquireSnapshot(sim, &alpha);
+            if (frameDump) {
+                alpha = 1.0f;
+            }
+        }
 
         // Start HUD frame and update controls
-        hud_new_frame();
         bool clearFromHUD = false;
-        float fps_for_ui = (dt > 1e-6f) ? (1.0f / dt) : (float)TARGET_FPS;
-        hud_update(fps_for_ui, numActive, &clearFromHUD, camera, &cameraRadius, &autoOrbit);
-
-        if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
-            addForce(verlets, numActive, (mfloat_t[]) { 0, 3, 0 }, -30.0f * NUM_SUBSTEPS);
+        bool traceFromHUD = false;
+        stats.fps = (dt > 1e-6f) ? (1.0f / dt) : (float)TARGET_FPS;
+        stats.numActive = snapshot->count;
+        int shownFrame = playbackControls.frame;
+        if (window) {
+            PROFILE_BEGIN(PROFILE_MAIN, PROFILE_HUD);
+            hud_new_frame();
+            hud_update(&stats, &clearFromHUD, camera, &cameraRadius, &autoOrbit, &impostors,
+                &packView.frustumCull, &packView.occlusionCull, &playbackControls, &traceFromHUD);
+            PROFILE_END(PROFILE_MAIN, PROFILE_HUD);
+        }
+        // Space pauses playback; the HUD slider scrubs it
+        static bool pauseHeld = false;
+        if (keyPressed(window, GLFW_KEY_SPACE, &pauseHeld)) {
+            playbackControls.paused = !playbackControls.paused;
+        }
+        if (playbackControls.frame != shownFrame) {
+            playbackTime = playbackControls.frame * SIM_STEP;
         }
 
         /* Camera */
@@ -171,177 +347,239 @@ int main() {
         createViewMatrix(view, camera);
 
         /* Shader Uniforms */
-        glUseProgram(phongShader);
-        glUniformMatrix4fv(glGetUniformLocation(phongShader, "view"),
-            1, GL_FALSE, view);
-        glUseProgram(0);
-        glUseProgram(baseShader);
-        glUniformMatrix4fv(glGetUniformLocation(baseShader, "view"),
-            1, GL_FALSE, view);
-        glUseProgram(0);
-        glUseProgram(instanceShader);
-        glUniformMatrix4fv(glGetUniformLocation(instanceShader, "view"),
-            1, GL_FALSE, view);
-        glUseProgram(0);
+        if (window) {
+            glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+        }
+        if (fbHeight > 0) {
+            createProjectionMatrix(projection, (float)fbWidth / (float)fbHeight);
+        }
+        updateCameraBuffer(cameraBuffer, view, projection);
         
         
         /* Render here */
+        if (frameDump) {
+            bindFrameDump(frameDump);
+        }
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
         
-        int spawnsThisFrame = 0; // Limit spawns per frame
+        const mfloat_t* containerPosition = snapshot->containerPosition;
         
-        if (1.0 / dt >= TARGET_FPS - 5 && glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS && numActive < MAX_INSTANCES) {
-            numActive += ADDITION_SPEED;
-        }
-        // Auto-spawn one red ball once per second at the top of the container
-        static double lastAutoSpawn = 0.0;
-        double now = glfwGetTime();
-        if (spawnsThisFrame < MAX_SPAWNS_PER_FRAME && (now - lastAutoSpawn) >= 1.0) {
-            // Spawn at the top (north pole) of the container sphere, offset by particle radius to keep it inside
-            mfloat_t pos[VEC3_SIZE] = { containerPosition[0], containerPosition[1] + CONTAINER_RADIUS - VERLET_RADIUS, containerPosition[2] };
-            mfloat_t vel[VEC3_SIZE] = {0, 0, 0}; // initial velocity
-            ParticleColor color = RED; // or random/color cycling
-            spawnVerlet(verlets, &numActive, MAX_INSTANCES, pos, vel, color, VERLET_RADIUS);
-            spawnsThisFrame++;
-            lastAutoSpawn = now;
-        }
-        if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
+        // A recording plays without a simulation thread, so nothing would drain
+        // commands queued for it
+        if (playback) {
+            rejectSimulationKeys(window, clearFromHUD);
+        } else {
+            int spawnsThisFrame = 0; // Limit spawns per frame
+
+            // G holds the attractor: the simulation applies it once per step
+            // until the key comes up, whatever the frame rate
+            static bool attracting = false;
+            if (keyDown(window, GLFW_KEY_G) != attracting) {
+                SimCommand attract = { .type = SIM_ATTRACT, .position = { 0, 3, 0 } };
+                attract.strength = attracting ? 0.0f : -30.0f * SIM_SUBSTEPS;
+                if (pushCommand(sim, &attract)) {
+                    attracting = !attracting;
+                }
+            }
+
+            if (1.0 / dt >= TARGET_FPS - 5 && keyDown(window, GLFW_KEY_V)) {
+                SimCommand insert = { .type = SIM_INSERT };
+                // The layout wraps around, so V keeps refilling whatever room despawns leave
+                for (int i = 0; i < ADDITION_SPEED && snapshot->count + i < MAX_INSTANCES; i++) {
+                    insert.object = ringVerlets[nextRing];
+                    if (!pushCommand(sim, &insert)) {
+                        break;
+                    }
+                    nextRing = (nextRing + 1) % MAX_INSTANCES;
+                }
+            }
+            // Auto-spawn one red ball once per simulated second at the top of the container
+            static unsigned long lastAutoSpawn = 0;
+            unsigned long now = snapshot->step;
             // Spawn at the top (north pole) of the container sphere, offset by particle radius to keep it inside
-            mfloat_t pos[VEC3_SIZE] = { containerPosition[0], containerPosition[1] + CONTAINER_RADIUS - VERLET_RADIUS, containerPosition[2] };
-            mfloat_t vel[VEC3_SIZE] = {0, 0, 0}; // initial velocity
-            ParticleColor color = RED; // or random/color cycling
-            spawnVerlet(verlets, &numActive, MAX_INSTANCES, pos, vel, color, VERLET_RADIUS);
-            spawnsThisFrame++;
-        }
-        if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
-            mfloat_t pos[VEC3_SIZE] = {0, 0, 0}; // spawn at origin or any position
-            mfloat_t vel[VEC3_SIZE] = {0, 0, 0}; // initial velocity
-            ParticleColor color = GREEN; // or random/color cycling
-            spawnVerlet(verlets, &numActive, MAX_INSTANCES, pos, vel, color, VERLET_RADIUS);
-            spawnsThisFrame++;
-        }
-        if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
-            mfloat_t pos[VEC3_SIZE] = {0, 0, 0}; // spawn at origin or any position
-            mfloat_t vel[VEC3_SIZE] = {0, 0, 0}; // initial velocity
-            ParticleColor color = BLUE; // or random/color cycling
-            spawnVerlet(verlets, &numActive, MAX_INSTANCES, pos, vel, color, VERLET_RADIUS);
-            spawnsThisFrame++;
+            mfloat_t top[VEC3_SIZE] = { containerPosition[0], containerPosition[1] + CONTAINER_RADIUS - VERLET_RADIUS, containerPosition[2] };
+            mfloat_t origin[VEC3_SIZE] = { 0, 0, 0 };
+            if (now < lastAutoSpawn) {
+                lastAutoSpawn = now; // F9 went back to an earlier step
+            }
+            if (spawnsThisFrame < MAX_SPAWNS_PER_FRAME && now - lastAutoSpawn >= (unsigned long)(1.0 / SIM_STEP)) {
+                queueSpawn(sim, top, RED, AUTO_SPAWN_LIFETIME);
+                spawnsThisFrame++;
+                lastAutoSpawn = now;
+            }
+            if (keyDown(window, GLFW_KEY_J) && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
+                queueSpawn(sim, top, RED, 0);
+                spawnsThisFrame++;
+            }
+            if (keyDown(window, GLFW_KEY_K) && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
+                queueSpawn(sim, origin, GREEN, 0);
+                spawnsThisFrame++;
+            }
+            if (keyDown(window, GLFW_KEY_L) && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
+                queueSpawn(sim, origin, BLUE, 0);
+                spawnsThisFrame++;
+            }
+            if (keyDown(window, GLFW_KEY_P) && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
+                queueSpawn(sim, origin, WHITE, 0);
+                spawnsThisFrame++;
+            } 
+
+            SimCommand move = { .type = SIM_MOVE_CONTAINER };
+            if (keyDown(window, GLFW_KEY_LEFT)) {
+                move.position[0] -= 0.05f;
+            }
+            if (keyDown(window, GLFW_KEY_RIGHT)) {
+                move.position[0] += 0.05f;
+            }
+            if (keyDown(window, GLFW_KEY_DOWN)) {
+                move.position[1] -= 0.05f;
+            }
+            if (keyDown(window, GLFW_KEY_UP)) {
+                move.position[1] += 0.05f;
+            }
+            if (move.position[0] != 0 || move.position[1] != 0) {
+                pushCommand(sim, &move);
+            }
+
+            // Hold 'D' to drain through the bottom of the container
+            if (keyDown(window, GLFW_KEY_D)) {
+                SimCommand drain = { .type = SIM_DRAIN, .radius = DRAIN_RADIUS };
+                pushCommand(sim, &drain);
+            }
+
+            // Press 'C' or HUD Clear to clear all accelerations for the next step
+            if ((keyDown(window, GLFW_KEY_C)) || clearFromHUD) {
+                SimCommand clear = { .type = SIM_CLEAR };
+                pushCommand(sim, &clear);
+            }
+            updatePicking(window, sim, camera);
+
+            // F5 saves the scene, F9 restores it
+            static bool saveHeld = false, loadHeld = false;
+            if (keyPressed(window, GLFW_KEY_F5, &saveHeld)) {
+                SimCommand save = { .type = SIM_SAVE, .path = SNAPSHOT_FILE };
+                pushCommand(sim, &save);
+            }
+            if (keyPressed(window, GLFW_KEY_F9, &loadHeld)) {
+                SimCommand load = { .type = SIM_LOAD, .path = SNAPSHOT_FILE };
+                pushCommand(sim, &load);
+            }
         }
-        if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS && spawnsThisFrame < MAX_SPAWNS_PER_FRAME) {
-            mfloat_t pos[VEC3_SIZE] = {0, 0, 0}; // spawn at origin or any position
-            mfloat_t vel[VEC3_SIZE] = {0, 0, 0}; // initial velocity
-            ParticleColor color = WHITE; // or random/color cycling
-            mfloat_t radius = VERLET_RADIUS; // or any desired radius
-            spawnVerlet(verlets, &numActive, MAX_INSTANCES, pos, vel, color, radius);
-            spawnsThisFrame++;
-        } 
-
-        //printf("Hello visiblecount: %d\n ", visibleCount); 
-
-        if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-            containerPosition[0] -= 0.05f;
+        // F8 or the Profiler window traces the next frames to trace-<n>.json
+        static bool traceHeld = false;
+        if (keyPressed(window, GLFW_KEY_F8, &traceHeld) || traceFromHUD) {
+            PROFILE_CAPTURE(options.traceFrames);
         }
-        if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-            containerPosition[0] += 0.05f;
+        int numActive = snapshot->count;
+        stats.simMs = snapshot->stepMs;
+        if (sim->recorder) {
+            TrajectoryStats recording;
+            getTrajectoryStats(sim->recorder, &recording);
+            stats.recording = true;
+            stats.recordRatio = recording.ratio;
+            stats.recordBacklog = recording.backlog;
+            stats.recordDropped = recording.dropped;
         }
-        if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-            containerPosition[1] -= 0.05f;
+
+        /* Instance data, written straight into this frame's stream region */
+        double phaseStart = monotonicTime();
+        InstanceData* instances = beginInstanceUpload(instanceStream);
+        double phaseEnd = monotonicTime();
+        double uploadTime = phaseEnd - phaseStart;
+        PROFILE_SPAN(PROFILE_MAIN, PROFILE_UPLOAD, phaseStart, phaseEnd);
+
+        phaseStart = phaseEnd;
+        updatePackView(&packView, projection, view, camera->position, fbHeight);
+        collectDepth(depthCapture, &depthPyramid);
+        if (!packView.occlusionCull) {
+            // Nothing is captured while culling is off; start over from fresh depth once it is back on
+            depthPyramid.valid = false;
         }
-        if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-            containerPosition[1] += 0.05f;
+        packInstances(snapshot->objects, snapshot->origins, alpha, numActive, &packView, instances, &packed);
+        phaseEnd = monotonicTime();
+        stats.packMs = (phaseEnd - phaseStart) * 1000.0;
+        PROFILE_SPAN(PROFILE_MAIN, PROFILE_PACK, phaseStart, phaseEnd);
+
+        if (window && totalFrames % 60 == 0) {
+            sprintf(title, "FPS : %-4.0f | Balls : %-10d | Inactive : %-10d", 1.0 / dt,numActive, packed.total);
+            glfwSetWindowTitle(window, title);
         }
 
-        float sub_dt = dt / NUM_SUBSTEPS;
-        // Press 'C' or HUD Clear to clear all accelerations this frame
-        bool clearAccels = (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) || clearFromHUD;
-        for (int i = 0; i < NUM_SUBSTEPS; i++) {
-            applyForces(verlets, numActive);
-            if (clearAccels) {
-                for (int j = 0; j < numActive; ++j) {
-                    vec3_zero(verlets[j].acceleration);
+        phaseStart = phaseEnd;
+        endInstanceUpload(instanceStream, packed.total);
+        phaseEnd = monotonicTime();
+        stats.uploadMs = (uploadTime + phaseEnd - phaseStart) * 1000.0;
+        PROFILE_SPAN(PROFILE_MAIN, PROFILE_UPLOAD, phaseStart, phaseEnd);
+
+        /* Draw instanced verlet objects, one call per level of detail */
+        phaseStart = phaseEnd;
+        if (impostors) {
+            bindInstanceStream(instanceStream, impostorMesh, 0);
+            drawInstanced(impostorMesh, impostorShader, GL_TRIANGLE_STRIP, packed.total);
+        } else {
+            for (int l = 0; l < NUM_LODS; l++) {
+                if (packed.lodCount[l] == 0) {
+                    continue;
                 }
+                bindInstanceStream(instanceStream, lodMeshes[l], packed.lodOffset[l]);
+                drawInstanced(lodMeshes[l], instanceShader, GL_TRIANGLES, packed.lodCount[l]);
             }
-            // applyCollisions(verlets, numActive);
-            applyGridCollisions(verlets, numActive);
-            applyConstraints(verlets, numActive, containerPosition);
-            // If clearing, also zero velocity by making previous == current before integration
-            if (clearAccels) {
-                for (int j = 0; j < numActive; ++j) {
-                    vec3_assign(verlets[j].previous, verlets[j].current);
-                }
-            }
-            updatePositions(verlets, numActive, sub_dt);
         }
-
-         // Assuming numActive is the number of active particles
-        float verletPositions[numActive * VEC3_SIZE];
-        float verletVelocities[numActive];
-        float verletColors[numActive * VEC3_SIZE]; // Array to store color data
-
-        int posPointer = 0;
-        int velPointer = 0;
-        int colorPointer = 0;
-        for (int i = 0; i < numActive; i++) {
-            VerletObject obj = verlets[i];
-            if (!obj.visible) continue; // Only process visible objects
-            // Position data
-            verletPositions[posPointer++] = obj.current[0];
-            verletPositions[posPointer++] = obj.current[1];
-            verletPositions[posPointer++] = obj.current[2];
-
-            // Velocity data
-            float vel = vec3_distance(obj.current, obj.previous) * 10;
-            verletVelocities[velPointer++] = vel;
-
-            // Color data
-            verletColors[colorPointer++] = obj.colorVector[0];
-            verletColors[colorPointer++] = obj.colorVector[1];
-            verletColors[colorPointer++] = obj.colorVector[2];
-            visibleCount++; // Count only visible objects
+        for (int l = 0; l < NUM_LODS; l++) {
+            stats.lodCounts[l] = packed.lodCount[l];
         }
-        
-        if (totalFrames % 60 == 0) {
-            sprintf(title, "FPS : %-4.0f | Balls : %-10d | Inactive : %-10d", 1.0 / dt,numActive, visibleCount);
-            glfwSetWindowTitle(window, title);
-        }
-        // Update position VBO
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->positionVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * visibleCount * VEC3_SIZE, verletPositions);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-        // Update velocity VBO
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->velocityVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * visibleCount, verletVelocities);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        stats.frustumCulled = packed.frustumCulled;
+        stats.occlusionCulled = packed.occlusionCulled;
 
-        // Update color VBO
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->colorVBO); // Assume you have created a VBO for colors
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * visibleCount * VEC3_SIZE, verletColors);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-
-
-        /* Draw instanced verlet objects */
-        drawInstanced(mesh, instanceShader, GL_TRIANGLES, visibleCount, verlets[0].radius);
+        /* Occluder depth for the next frame, before the container points land in it */
+        if (packView.occlusionCull) {
+            captureDepth(depthCapture, fbWidth, fbHeight, view, projection);
+        }
 
         /* Container */
-        drawMesh(mesh, baseShader, GL_POINTS, containerPosition, rotation, CONTAINER_RADIUS * 1.02);
-
-        // Render HUD on top
-        hud_render();
+        drawMesh(containerMesh, baseShader, GL_POINTS, (mfloat_t*)containerPosition, rotation, CONTAINER_RADIUS * 1.02);
+        fenceInstanceStream(instanceStream);
+        phaseEnd = monotonicTime();
+        stats.drawMs = (phaseEnd - phaseStart) * 1000.0;
+        PROFILE_SPAN(PROFILE_MAIN, PROFILE_DRAW, phaseStart, phaseEnd);
+
+        if (window) {
+            // Render HUD on top
+            PROFILE_BEGIN(PROFILE_MAIN, PROFILE_HUD);
+            hud_render();
+            PROFILE_END(PROFILE_MAIN, PROFILE_HUD);
+
+            // Swap front and back buffers
+            PROFILE_BEGIN(PROFILE_MAIN, PROFILE_SWAP);
+            glfwSwapBuffers(window);
+            PROFILE_END(PROFILE_MAIN, PROFILE_SWAP);
+        } else {
+            captureFrame(frameDump);
+        }
 
-        // Swap front and back buffers
-        glfwSwapBuffers(window);
-        
-        // Poll for and process events
-        glfwPollEvents();
+        if (totalFrames == 0) {
+            // Startup cost, dominated by shader builds on a cold cache
+            int cacheHits, cacheCompiles;
+            getShaderCacheStats(&cacheHits, &cacheCompiles);
+            printf("First frame after %.1f ms (%d programs from cache, %d compiled)\n",
+                (monotonicTime() - startTime) * 1000.0, cacheHits, cacheCompiles);
+        }
         
         /* Timing */
-        dt = (float)glfwGetTime() - lastFrameTime;
-        while (dt < 1.0f / TARGET_FPS) {
-            dt = (float)glfwGetTime() - lastFrameTime;
+        if (window) {
+            // Poll for and process events
+            glfwPollEvents();
+            dt = (float)waitNextFrame(&frameScheduler);
+        } else {
+            // Offline frames run flat out, each one a full step
+            dt = SIM_STEP;
         }
-        lastFrameTime = (float)glfwGetTime();
+        if (playback && !playbackControls.paused) {
+            playbackTime = MFMIN(playbackTime + dt, (playback->numFrames - 1) * SIM_STEP);
+        }
+        stats.jitterMs = frameScheduler.jitterMs;
+        stats.maxJitterMs = frameScheduler.maxJitterMs;
+        PROFILE_FRAME(&profile);
         totalFrames++;
         //if (numActive > 0) {
         //    VerletObject* obj = &verlets[0];
@@ -352,41 +590,200 @@ int main() {
         //}
     }
     // Shutdown HUD
-    hud_shutdown();
-    free(verlets);
-    glfwTerminate();
+    if (window) {
+        hud_shutdown();
+    }
+    TrajectoryRecorder* recorder = sim->recorder;
+    Exporter* exporter = sim->exporter;
+    InputLog* inputLog = sim->inputLog;
+    InputLog* replay = sim->replay;
+    destroySimulation(sim);
+    if (inputLog) {
+        closeInputLog(inputLog);
+    }
+    if (replay) {
+        closeInputLog(replay);
+    }
+    if (scene) {
+        destroyScene(scene);
+    }
+    if (recorder) {
+        // Writes out the steps still queued
+        destroyTrajectoryRecorder(recorder);
+    }
+    if (exporter) {
+        destroyExporter(exporter);
+    }
+    if (frameDump) {
+        // Writes out the frames still in flight
+        destroyFrameDump(frameDump);
+    }
+    if (playback) {
+        closePlayback(playback);
+    }
+    stopWorkers();
+    destroyInstanceStream(instanceStream);
+    destroyDepthCapture(depthCapture);
+    destroyDepthPyramid(&depthPyramid);
+    destroyCameraBuffer(cameraBuffer);
+    destroyShader(phongShader);
+    destroyShader(instanceShader);
+    destroyShader(baseShader);
+    destroyShader(impostorShader);
+    free(ringVerlets);
+    if (window) {
+        glfwTerminate();
+    } else {
+        destroyHeadlessContext(&headlessContext);
+    }
     return 0;
 }
 
+bool parseOptions(int argc, char** argv, Options* options)
+{
+    options->headless = false;
+    options->frames = 600;
+    options->output = "frames";
+    options->width = SCR_WIDTH;
+    options->height = SCR_HEIGHT;
+    options->particles = 2000;
+    options->load = NULL;
+    options->record = NULL;
+    options->play = NULL;
+    options->exportDirectory = NULL;
+    options->exportFormat = EXPORT_VTK;
+    options->exportEvery = 10;
+    options->logInput = NULL;
+    options->replay = NULL;
+    options->scene = NULL;
+    options->traceFrames = PROFILE_TRACE_FRAMES;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--headless") == 0) {
+            options->headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && hasValue && parseInt(argv[i + 1], &options->frames)) {
+            i++;
+        } else if (strcmp(argv[i], "--output") == 0 && hasValue) {
+            options->output = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && hasValue) {
+            if (sscanf(argv[++i], "%dx%d", &options->width, &options->height) != 2) {
+                options->width = options->height = 0;
+            }
+        } else if (strcmp(argv[i], "--particles") == 0 && hasValue && parseInt(argv[i + 1], &options->particles)) {
+            i++;
+        } else if (strcmp(argv[i], "--load") == 0 && hasValue) {
+            options->load = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && hasValue) {
+            options->record = argv[++i];
+        } else if (strcmp(argv[i], "--play") == 0 && hasValue) {
+            options->play = argv[++i];
+        } else if (strcmp(argv[i], "--export") == 0 && hasValue) {
+            options->exportDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--export-format") == 0 && hasValue
+            && parseExportFormat(argv[i + 1], &options->exportFormat)) {
+            i++;
+        } else if (strcmp(argv[i], "--export-every") == 0 && hasValue && parseInt(argv[i + 1], &options->exportEvery)) {
+            i++;
+        } else if (strcmp(argv[i], "--log-input") == 0 && hasValue) {
+            options->logInput = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && hasValue) {
+            options->replay = argv[++i];
+        } else if (strcmp(argv[i], "--scene") == 0 && hasValue) {
+            options->scene = argv[++i];
+        } else if (strcmp(argv[i], "--trace-frames") == 0 && hasValue && parseInt(argv[i + 1], &options->traceFrames)) {
+            i++;
+        } else {
+            printf("Usage: %s [--scene SCENE] [--load SNAPSHOT] [--record TRAJECTORY | --play TRAJECTORY]\n"
+                   "    [--log-input LOG] [--replay LOG] [--trace-frames N]\n"
+                   "    [--export DIR [--export-format vtk|ply|xyz] [--export-every N]]\n"
+                   "    [--headless [--frames N] [--output DIR|-] [--size WxH] [--particles N]]\n", argv[0]);
+            return false;
+        }
+    }
+    if (options->width <= 0 || options->height <= 0) {
+        printf("Invalid --size\n");
+        return false;
+    }
+    if (options->frames <= 0 || options->exportEvery <= 0) {
+        printf("Need at least 1 for --frames and --export-every\n");
+        return false;
+    }
+    if (options->particles <= 0 || options->particles > MAX_INSTANCES) {
+        printf("Need 1 to %d --particles\n", MAX_INSTANCES);
+        return false;
+    }
+    if (options->traceFrames <= 0 || options->traceFrames > PROFILE_TRACE_MAX_FRAMES) {
+        printf("Need 1 to %d --trace-frames\n", PROFILE_TRACE_MAX_FRAMES);
+        return false;
+    }
+    return true;
+}
+
+// The whole of text as a decimal int; anything else falls through to the usage
+bool parseInt(const char* text, int* value)
+{
+    char* end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || parsed < INT_MIN || parsed > INT_MAX) {
+        return false;
+    }
+    *value = (int)parsed;
+    return true;
+}
+
+// Key state, always released without a window
+bool keyDown(GLFWwindow* window, int key)
+{
+    return window && glfwGetKey(window, key) == GLFW_PRESS;
+}
+
+// True only on the frame the key goes down
+bool keyPressed(GLFWwindow* window, int key, bool* held)
+{
+    bool down = keyDown(window, key);
+    bool pressed = down && !*held;
+    *held = down;
+    return pressed;
+}
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void processInput(GLFWwindow* window)
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (keyDown(window, GLFW_KEY_ESCAPE))
         glfwSetWindowShouldClose(window, true);
 
     // Axis-aligned camera views
-    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS) {
+    if (keyDown(window, GLFW_KEY_X)) {
         autoOrbit = false;
         camera->pitch = 0.0f;      // level
         camera->yaw = 180.0f;      // look toward -X from +X
         vec3(camera->position, cameraRadius, 0.0f, 0.0f);
     }
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS) {
+    if (keyDown(window, GLFW_KEY_Y)) {
         autoOrbit = false;
         camera->pitch = -90.0f;    // look down along -Y from +Y
         // yaw is irrelevant when pitch is +/-90
         vec3(camera->position, 0.0f, cameraRadius, 0.0f);
     }
-    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS) {
+    if (keyDown(window, GLFW_KEY_Z)) {
         autoOrbit = false;
         camera->pitch = 0.0f;      // level
         camera->yaw = -90.0f;      // look toward -Z from +Z
         vec3(camera->position, 0.0f, 0.0f, cameraRadius);
     }
     // Resume orbit
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) {
+    if (keyDown(window, GLFW_KEY_O)) {
         autoOrbit = true;
     }
+    // Toggle sphere impostors on press
+    static bool impostorKeyHeld = false;
+    bool impostorKey = keyDown(window, GLFW_KEY_I);
+    if (impostorKey && !impostorKeyHeld) {
+        impostors = !impostors;
+    }
+    impostorKeyHeld = impostorKey;
 }
 
 void updateCamera(GLFWwindow* window, Mouse* mouse, Camera* camera)
@@ -401,19 +798,55 @@ void updateCamera(GLFWwindow* window, Mouse* mouse, Camera* camera)
         camera->yaw = universalAngle + 180.0f;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
+    if (keyDown(window, GLFW_KEY_W)) {
         vec3_add(camera->position, camera->position, vec3_multiply_f(temp, camera->up, speed));
         camera->pitch -= 0.22f;
         cameraRadius -= 0.01f;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
+    if (keyDown(window, GLFW_KEY_S)) {
         vec3_subtract(camera->position, camera->position, vec3_multiply_f(temp, camera->up, speed));
         camera->pitch += 0.22f;
         cameraRadius += 0.01f;
     }
 }
 
+// Left mouse grabs the particle under the screen center and carries it at the
+// same distance in front of the camera until released
+void updatePicking(GLFWwindow* window, Simulation* sim, Camera* camera)
+{
+    static bool buttonHeld = false;
+    static ParticleHandle dragged = { INVALID_SLOT, 0 };
+    static mfloat_t dragDistance = 0.0f;
+
+    bool button = window && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+    if (button && !buttonHeld) {
+        SimCommand pick = { .type = SIM_PICK };
+        vec3_assign(pick.position, camera->position);
+        vec3_assign(pick.velocity, camera->forwards);
+        pushCommand(sim, &pick);
+    }
+    buttonHeld = button;
+
+    // The answer arrives with the next step
+    RayHit hit;
+    while (takeRayHits(sim, &hit, 1)) {
+        if (button && hit.handle.slot != INVALID_SLOT) {
+            dragged = hit.handle;
+            dragDistance = hit.distance + VERLET_RADIUS;
+        }
+    }
+
+    if (!button) {
+        dragged.slot = INVALID_SLOT;
+    } else if (dragged.slot != INVALID_SLOT) {
+        SimCommand drag = { .type = SIM_DRAG, .handle = dragged };
+        vec3_multiply_f(drag.position, camera->forwards, dragDistance);
+        vec3_add(drag.position, drag.position, camera->position);
+        pushCommand(sim, &drag);
+    }
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
@@ -432,6 +865,29 @@ void cursor_enter_callback(GLFWwindow* window, int entered)
         // The cursor left the content area of the window
     }
 }
+// Playback has no simulation to steer; say so once instead of queueing commands
+void rejectSimulationKeys(GLFWwindow* window, bool clearFromHUD)
+{
+    static const int simulationKeys[] = { GLFW_KEY_G, GLFW_KEY_V, GLFW_KEY_J, GLFW_KEY_K, GLFW_KEY_L, GLFW_KEY_P,
+        GLFW_KEY_LEFT, GLFW_KEY_RIGHT, GLFW_KEY_DOWN, GLFW_KEY_UP, GLFW_KEY_D, GLFW_KEY_C, GLFW_KEY_F5, GLFW_KEY_F9 };
+    static bool told = false;
+    bool pressed = clearFromHUD || (window && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS);
+    for (int k = 0; k < (int)(sizeof(simulationKeys) / sizeof(simulationKeys[0])); k++) {
+        pressed = pressed || keyDown(window, simulationKeys[k]);
+    }
+    if (pressed && !told) {
+        printf("Simulation controls are off while playing a recording\n");
+        told = true;
+    }
+}
+
+void queueSpawn(Simulation* sim, mfloat_t* position, ParticleColor color, mfloat_t lifetime)
+{
+    SimCommand spawn = { .type = SIM_SPAWN, .color = color, .radius = VERLET_RADIUS, .lifetime = lifetime };
+    vec3_assign(spawn.position, position);
+    pushCommand(sim, &spawn);
+}
+
 void instantiateVerlets(VerletObject* objects, int size)
 {
     int distance = 7.0f;
@@ -456,26 +912,8 @@ void instantiateVerlets(VerletObject* objects, int size)
         setColorVector(obj);
         // Initialize mass from color
         setMassFromColor(obj);
+        obj->lifetime = 0;
         //obj->numBonds = 0;
         //obj->bonds = NULL;  // Initially no bonds 
     }
 }
-void spawnVerlet(VerletObject* objects, int* numActive, int maxInstances, mfloat_t* position, mfloat_t* velocity, ParticleColor color, mfloat_t radius)
-{
-    if (*numActive >= maxInstances) {
-        return; // Cannot spawn more objects
-    }
-
-    VerletObject* obj = &objects[*numActive];
-    vec3(obj->current, position[0], position[1], position[2]);
-    vec3(obj->previous, position[0] - velocity[0], position[1] - velocity[1], position[2] - velocity[2]);
-    vec3(obj->acceleration, 0, 0, 0);
-    obj->radius = radius;
-    obj->color = color;
-    setColorVector(obj);
-    // Initialize mass from color
-    setMassFromColor(obj);
-    obj->visible = true;
-
-    (*numActive)++;
-}
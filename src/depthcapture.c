@@ -0,0 +1,169 @@
+#include "depthcapture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void resizeCapture(DepthCapture* capture, int width, int height)
+{
+    capture->width = width;
+    capture->height = height;
+    capture->reducedWidth = (width + HIZ_BLOCK - 1) / HIZ_BLOCK;
+    capture->reducedHeight = (height + HIZ_BLOCK - 1) / HIZ_BLOCK;
+
+    glBindTexture(GL_TEXTURE_2D, capture->depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+    glBindTexture(GL_TEXTURE_2D, capture->reduceTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, capture->reducedWidth, capture->reducedHeight, 0, GL_RED, GL_FLOAT, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    for (int i = 0; i < HIZ_BUFFERS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->PBOs[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, sizeof(float) * capture->reducedWidth * capture->reducedHeight, NULL, GL_STREAM_READ);
+        // Anything still in flight has the old size
+        if (capture->fences[i]) {
+            glDeleteSync(capture->fences[i]);
+            capture->fences[i] = NULL;
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+DepthCapture* createDepthCapture()
+{
+    DepthCapture* capture = malloc(sizeof(DepthCapture));
+    memset(capture, 0, sizeof(DepthCapture));
+
+    char defines[32];
+    snprintf(defines, sizeof(defines), "#define BLOCK_SIZE %d\n", HIZ_BLOCK);
+    capture->reduceShader = createShader("shaders/depth_reduce_vertex.glsl", "shaders/depth_reduce_fragment.glsl", defines);
+    glGenVertexArrays(1, &(capture->emptyVAO));
+
+    unsigned int textures[2];
+    glGenTextures(2, textures);
+    capture->depthTexture = textures[0];
+    capture->reduceTexture = textures[1];
+    for (int i = 0; i < 2; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, capture->depthTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenBuffers(HIZ_BUFFERS, capture->PBOs);
+    glGenFramebuffers(1, &(capture->reduceFBO));
+
+    // Size is only known at the first capture
+    capture->width = capture->height = 0;
+    return capture;
+}
+
+void destroyDepthCapture(DepthCapture* capture)
+{
+    for (int i = 0; i < HIZ_BUFFERS; i++) {
+        if (capture->fences[i]) {
+            glDeleteSync(capture->fences[i]);
+        }
+    }
+    glDeleteBuffers(HIZ_BUFFERS, capture->PBOs);
+    glDeleteFramebuffers(1, &(capture->reduceFBO));
+    glDeleteTextures(1, &(capture->depthTexture));
+    glDeleteTextures(1, &(capture->reduceTexture));
+    glDeleteVertexArrays(1, &(capture->emptyVAO));
+    destroyShader(capture->reduceShader);
+    free(capture);
+}
+
+void captureDepth(DepthCapture* capture, int width, int height, mfloat_t* view, mfloat_t* projection)
+{
+    // The scene may be drawn into the window or an offscreen target
+    GLint sceneFBO = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &sceneFBO);
+
+    if (width != capture->width || height != capture->height) {
+        resizeCapture(capture, width, height);
+        glBindFramebuffer(GL_FRAMEBUFFER, capture->reduceFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, capture->reduceTexture, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    }
+
+    int slot = capture->next;
+    if (capture->fences[slot]) {
+        // Never collected, the newer capture replaces it
+        glDeleteSync(capture->fences[slot]);
+        capture->fences[slot] = NULL;
+    }
+
+    // Copy the depth of the scene framebuffer
+    glBindTexture(GL_TEXTURE_2D, capture->depthTexture);
+    glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+    // Reduce to one texel per block
+    glBindFramebuffer(GL_FRAMEBUFFER, capture->reduceFBO);
+    glViewport(0, 0, capture->reducedWidth, capture->reducedHeight);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+
+    // depthTexture samples unit 0, the sampler default
+    useShader(capture->reduceShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(capture->emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // Start the asynchronous read into this slot's PBO
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->PBOs[slot]);
+    glReadPixels(0, 0, capture->reducedWidth, capture->reducedHeight, GL_RED, GL_FLOAT, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    memcpy(capture->views[slot], view, sizeof(capture->views[slot]));
+    memcpy(capture->projections[slot], projection, sizeof(capture->projections[slot]));
+    capture->next = (slot + 1) % HIZ_BUFFERS;
+
+    // Restore the state the scene pass expects
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glViewport(0, 0, width, height);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glEnable(GL_CULL_FACE);
+}
+
+bool collectDepth(DepthCapture* capture, DepthPyramid* pyramid)
+{
+    // Walk from the newest capture back and take the first one that is done
+    for (int age = 1; age <= HIZ_BUFFERS; age++) {
+        int slot = (capture->next - age + HIZ_BUFFERS) % HIZ_BUFFERS;
+        GLsync fence = capture->fences[slot];
+        if (!fence) {
+            continue;
+        }
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            continue;
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, capture->PBOs[slot]);
+        GLsizeiptr size = sizeof(float) * capture->reducedWidth * capture->reducedHeight;
+        const float* depth = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (depth) {
+            buildDepthPyramid(pyramid, depth, capture->reducedWidth, capture->reducedHeight,
+                capture->views[slot], capture->projections[slot]);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // Older captures still pending are simply overwritten later
+        glDeleteSync(fence);
+        capture->fences[slot] = NULL;
+        return depth != NULL;
+    }
+    return false;
+}
@@ -0,0 +1,42 @@
+#ifndef __DEPTHCAPTURE_H__
+#define __DEPTHCAPTURE_H__
+
+#include <stdbool.h>
+
+#include <GL/glew.h>
+
+#include "mathc.h"
+#include "occlusion.h"
+#include "shader.h"
+
+#define HIZ_BLOCK 8   // Framebuffer pixels per side of one read-back texel
+#define HIZ_BUFFERS 2 // Read-backs in flight
+
+// Copies the depth buffer, max-reduces it on the GPU and reads the small
+// result back through pixel buffer objects, so the CPU picks it up a frame
+// later without ever waiting on the GPU.
+typedef struct {
+    unsigned int depthTexture;  // Full resolution copy of the depth buffer
+    unsigned int reduceFBO;
+    unsigned int reduceTexture; // R32F, one texel per HIZ_BLOCK x HIZ_BLOCK pixels
+    ShaderProgram* reduceShader;
+    unsigned int emptyVAO;
+    unsigned int PBOs[HIZ_BUFFERS];
+    GLsync fences[HIZ_BUFFERS];
+    mfloat_t views[HIZ_BUFFERS][MAT4_SIZE];
+    mfloat_t projections[HIZ_BUFFERS][MAT4_SIZE];
+    int width, height;              // Framebuffer size the textures were made for
+    int reducedWidth, reducedHeight;
+    int next;
+} DepthCapture;
+
+DepthCapture* createDepthCapture();
+void destroyDepthCapture(DepthCapture* capture);
+
+// Snapshot the bound framebuffer's depth; call right after the occluders are drawn
+void captureDepth(DepthCapture* capture, int width, int height, mfloat_t* view, mfloat_t* projection);
+
+// Rebuild the pyramid from the newest capture the GPU has finished, if any
+bool collectDepth(DepthCapture* capture, DepthPyramid* pyramid);
+
+#endif
@@ -0,0 +1,236 @@
+#include "emitter.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILL_MIN_SPACING 1.02f // Closest lattice spacing, in particle diameters
+#define FILL_SURPLUS 1.15f     // Extra sites to make up for rejected and clipped ones
+#define FILL_JITTER 1.5f       // Jitter over the largest one that can never overlap
+#define FILL_MAX_SITES (1 << 26)
+#define FILL_PASSES 4          // Attempts at a spacing that gives enough sites
+
+typedef struct {
+    const FillVolume* volume;
+    const mfloat_t* container;
+    mfloat_t origin[VEC3_SIZE]; // Corner of the lattice
+    mfloat_t spacing;
+    mfloat_t jitter;            // Largest offset from a site's centre per axis
+    int dims[3];
+    uint32_t seed;
+    mfloat_t* points;  // VEC3_SIZE per site
+    uint8_t* candidate; // Site holds a point after the first pass
+    uint8_t* keep;      // ... and it survived the second
+} Lattice;
+
+// Random bits for one site, independent of which worker asks
+static uint32_t hashSite(uint32_t seed, uint32_t site, uint32_t stream)
+{
+    uint32_t x = seed ^ (site * 0x9E3779B9u) ^ (stream * 0x85EBCA6Bu);
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static bool insideVolume(const FillVolume* volume, const mfloat_t* point, const mfloat_t* container)
+{
+    const mfloat_t r = VERLET_RADIUS;
+    if (vec3_distance((mfloat_t*)point, (mfloat_t*)container) > CONTAINER_RADIUS - r) {
+        return false;
+    }
+    if (volume->shape == FILL_SPHERE) {
+        return vec3_distance((mfloat_t*)point, (mfloat_t*)volume->center) <= volume->radius - r;
+    }
+    for (int a = 0; a < 3; a++) {
+        if (point[a] < volume->min[a] + r || point[a] > volume->max[a] - r) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether point overlaps a particle that was in the store before the fill
+static bool touchesStore(const mfloat_t* point)
+{
+    int cell[3];
+    gridCoordinates(point, cell);
+    for (int x = cell[0] - 1; x <= cell[0] + 1; x++) {
+        for (int y = cell[1] - 1; y <= cell[1] + 1; y++) {
+            for (int z = cell[2] - 1; z <= cell[2] + 1; z++) {
+                if (x < 0 || y < 0 || z < 0 || x >= DIMENSION || y >= DIMENSION || z >= DIMENSION) {
+                    continue;
+                }
+                for (Node* node = grid[x][y][z]; node; node = node->next) {
+                    if (vec3_distance(node->val->current, (mfloat_t*)point) < node->val->radius + VERLET_RADIUS) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Pass one: a jittered point per site, kept if it is inside the volume
+static void placeSites(int worker, void* arg)
+{
+    Lattice* lattice = arg;
+    int start, end;
+    workerRange(worker, lattice->dims[2], &start, &end);
+    for (int z = start; z < end; z++) {
+        for (int y = 0; y < lattice->dims[1]; y++) {
+            for (int x = 0; x < lattice->dims[0]; x++) {
+                int site = x + lattice->dims[0] * (y + lattice->dims[1] * z);
+                int index[3] = { x, y, z };
+                mfloat_t* point = &lattice->points[site * VEC3_SIZE];
+                for (int a = 0; a < 3; a++) {
+                    mfloat_t unit = (hashSite(lattice->seed, site, a) >> 8) * (1.0f / 16777216.0f);
+                    point[a] = lattice->origin[a] + (index[a] + 0.5f) * lattice->spacing + (2.0f * unit - 1.0f) * lattice->jitter;
+                }
+                lattice->candidate[site] = insideVolume(lattice->volume, point, lattice->container) && !touchesStore(point);
+            }
+        }
+    }
+}
+
+// Pass two: of two points that came too close, the one with the higher
+// priority stays. Jitter stays under half a spacing, so only the 26
+// neighbouring sites can be in reach.
+static void rejectSites(int worker, void* arg)
+{
+    Lattice* lattice = arg;
+    const int* dims = lattice->dims;
+    int start, end;
+    workerRange(worker, dims[2], &start, &end);
+    for (int z = start; z < end; z++) {
+        for (int y = 0; y < dims[1]; y++) {
+            for (int x = 0; x < dims[0]; x++) {
+                int site = x + dims[0] * (y + dims[1] * z);
+                if (!lattice->candidate[site]) {
+                    lattice->keep[site] = false;
+                    continue;
+                }
+                uint32_t priority = hashSite(lattice->seed, site, 3);
+                bool keep = true;
+                for (int dz = -1; dz <= 1 && keep; dz++) {
+                    for (int dy = -1; dy <= 1 && keep; dy++) {
+                        for (int dx = -1; dx <= 1 && keep; dx++) {
+                            int nx = x + dx, ny = y + dy, nz = z + dz;
+                            if (nx < 0 || ny < 0 || nz < 0 || nx >= dims[0] || ny >= dims[1] || nz >= dims[2]) {
+                                continue;
+                            }
+                            int other = nx + dims[0] * (ny + dims[1] * nz);
+                            if (other == site || !lattice->candidate[other]) {
+                                continue;
+                            }
+                            mfloat_t distance = vec3_distance(&lattice->points[site * VEC3_SIZE], &lattice->points[other * VEC3_SIZE]);
+                            if (distance < 2.0f * VERLET_RADIUS) {
+                                uint32_t otherPriority = hashSite(lattice->seed, other, 3);
+                                keep = priority > otherPriority || (priority == otherPriority && site < other);
+                            }
+                        }
+                    }
+                }
+                lattice->keep[site] = keep;
+            }
+        }
+    }
+}
+
+int fillVolume(ParticleStore* store, const FillVolume* volume, const mfloat_t* containerPosition, uint32_t seed)
+{
+    // Bounds of the volume, clipped to the container's
+    mfloat_t lo[VEC3_SIZE], hi[VEC3_SIZE];
+    mfloat_t boundsVolume = 1.0f;
+    for (int a = 0; a < 3; a++) {
+        lo[a] = volume->shape == FILL_SPHERE ? volume->center[a] - volume->radius : volume->min[a];
+        hi[a] = volume->shape == FILL_SPHERE ? volume->center[a] + volume->radius : volume->max[a];
+        lo[a] = fmaxf(lo[a], containerPosition[a] - CONTAINER_RADIUS);
+        hi[a] = fminf(hi[a], containerPosition[a] + CONTAINER_RADIUS);
+        if (hi[a] <= lo[a]) {
+            return 0;
+        }
+        boundsVolume *= hi[a] - lo[a];
+    }
+    mfloat_t shapeVolume = volume->shape == FILL_SPHERE ? 4.0f / 3.0f * MPI * powf(volume->radius, 3.0f) : boundsVolume;
+    mfloat_t containerVolume = 4.0f / 3.0f * MPI * powf(CONTAINER_RADIUS, 3.0f);
+    mfloat_t space = fminf(fminf(shapeVolume, boundsVolume), containerVolume);
+
+    int capacity = store->capacity - store->count;
+    int count = volume->count < capacity ? volume->count : capacity;
+    if (count <= 0) {
+        return 0;
+    }
+
+    // One site per particle wanted, plus some to spare
+    Lattice lattice = { .volume = volume, .container = containerPosition, .seed = seed };
+    const mfloat_t diameter = 2.0f * VERLET_RADIUS;
+    const mfloat_t wanted = count * FILL_SURPLUS;
+    // Never closer than FILL_MIN_SPACING, nor so close that the sites run past FILL_MAX_SITES
+    const mfloat_t closest = fmaxf(diameter * FILL_MIN_SPACING, cbrtf(boundsVolume / FILL_MAX_SITES) * 1.01f);
+    lattice.spacing = fmaxf(cbrtf(space / wanted), closest);
+    vec3_assign(lattice.origin, lo);
+
+    clearGrid();
+    fillGrid(store->objects, store->count);
+    long sites = 0;
+    for (int pass = 0; pass < FILL_PASSES; pass++) {
+        long needed = 1;
+        for (int a = 0; a < 3; a++) {
+            lattice.dims[a] = (int)ceilf((hi[a] - lo[a]) / lattice.spacing);
+            needed *= lattice.dims[a];
+        }
+        if (needed > sites) {
+            lattice.points = realloc(lattice.points, sizeof(mfloat_t) * VEC3_SIZE * needed);
+            lattice.candidate = realloc(lattice.candidate, needed);
+            lattice.keep = realloc(lattice.keep, needed);
+        }
+        sites = needed;
+        lattice.jitter = fminf(FILL_JITTER * 0.5f * (lattice.spacing - diameter), 0.5f * lattice.spacing);
+        runWorkers(placeSites, &lattice);
+
+        // The bounds overestimate what a clipped shape or the particles
+        // already there leave, so tighten the lattice to what was found
+        long found = 0;
+        for (long site = 0; site < sites; site++) {
+            found += lattice.candidate[site];
+        }
+        mfloat_t tighter = fmaxf(lattice.spacing * cbrtf((found + 1.0f) / wanted), closest);
+        if (found >= wanted || tighter >= lattice.spacing * 0.99f || pass == FILL_PASSES - 1) {
+            break;
+        }
+        lattice.spacing = tighter;
+    }
+    runWorkers(rejectSites, &lattice);
+    clearGrid();
+
+    static const ParticleColor mixed[] = { RED, GREEN, BLUE };
+    int placed = 0;
+    for (long site = 0; site < sites && placed < count; site++) {
+        if (!lattice.keep[site]) {
+            continue;
+        }
+        VerletObject obj;
+        memset(&obj, 0, sizeof(obj));
+        vec3_assign(obj.current, &lattice.points[site * VEC3_SIZE]);
+        vec3_assign(obj.previous, obj.current);
+        obj.radius = VERLET_RADIUS;
+        obj.color = volume->species == FILL_MIXED ? mixed[placed % 3] : (ParticleColor)volume->species;
+        setColorVector(&obj);
+        setMassFromColor(&obj);
+        insertParticle(store, &obj);
+        placed++;
+    }
+    if (placed < count) {
+        printf("Volume only fits %d of %d particles\n", placed, count);
+    }
+
+    free(lattice.points);
+    free(lattice.candidate);
+    free(lattice.keep);
+    return placed;
+}
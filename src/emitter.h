@@ -0,0 +1,35 @@
+#ifndef __EMITTER_H__
+#define __EMITTER_H__
+
+#include <stdint.h>
+
+#include "particles.h"
+
+#define FILL_MIXED -1 // species: cycle red, green and blue like the ring
+
+typedef enum {
+    FILL_SPHERE, // center, radius
+    FILL_BOX,    // min, max
+} FillShape;
+
+// A volume to fill with particles at rest
+typedef struct {
+    FillShape shape;
+    mfloat_t center[VEC3_SIZE];
+    mfloat_t radius;
+    mfloat_t min[VEC3_SIZE];
+    mfloat_t max[VEC3_SIZE];
+    int species; // ParticleColor or FILL_MIXED
+    int count;
+} FillVolume;
+
+// Bulk emitter: place up to volume->count particles of VERLET_RADIUS inside
+// the volume and the container, none overlapping each other or the particles
+// already in the store. Points are jittered lattice sites sized from the
+// count; the lattice doubles as the spatial hash for rejecting neighbours
+// that came too close. Both passes run on the worker pool and only depend on
+// seed, so a fill is the same every time. Uses the collision grid, so call it
+// while the simulation is not stepping. Returns how many were placed.
+int fillVolume(ParticleStore* store, const FillVolume* volume, const mfloat_t* containerPosition, uint32_t seed);
+
+#endif
@@ -0,0 +1,254 @@
+#define _POSIX_C_SOURCE 200809L // mkdir
+
+#include "export.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char* extensions[] = { "vtk", "ply", "xyz" };
+static const char* speciesNames[] = { "Red", "Green", "Blue", "White" };
+
+bool parseExportFormat(const char* name, ExportFormat* format)
+{
+    for (int f = 0; f < (int)(sizeof(extensions) / sizeof(extensions[0])); f++) {
+        if (strcmp(name, extensions[f]) == 0) {
+            *format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Legacy VTK binary data is big endian
+static unsigned char* putBigEndian(unsigned char* out, const void* value)
+{
+    uint32_t bits;
+    memcpy(&bits, value, sizeof(bits));
+    out[0] = bits >> 24;
+    out[1] = bits >> 16;
+    out[2] = bits >> 8;
+    out[3] = bits;
+    return out + 4;
+}
+
+static void writeVTK(FILE* fp, const ExportBuffer* buffer, unsigned char* scratch)
+{
+    int n = buffer->count;
+    const VerletObject* objects = buffer->objects;
+
+    fprintf(fp, "# vtk DataFile Version 3.0\nverlet step %lu\nBINARY\nDATASET POLYDATA\n", buffer->step);
+    fprintf(fp, "POINTS %d float\n", n);
+    unsigned char* out = scratch;
+    for (int i = 0; i < n; i++) {
+        for (int a = 0; a < 3; a++) {
+            float value = objects[i].current[a];
+            out = putBigEndian(out, &value);
+        }
+    }
+    fwrite(scratch, 1, out - scratch, fp);
+
+    // One vertex cell per point so the points render without a glyph filter
+    fprintf(fp, "\nVERTICES %d %d\n", n, 2 * n);
+    out = scratch;
+    for (int32_t i = 0; i < n; i++) {
+        int32_t one = 1;
+        out = putBigEndian(out, &one);
+        out = putBigEndian(out, &i);
+    }
+    fwrite(scratch, 1, out - scratch, fp);
+
+    fprintf(fp, "\nPOINT_DATA %d\nSCALARS speed float 1\nLOOKUP_TABLE default\n", n);
+    out = scratch;
+    for (int i = 0; i < n; i++) {
+        float speed = vec3_distance((mfloat_t*)objects[i].current, (mfloat_t*)objects[i].previous);
+        out = putBigEndian(out, &speed);
+    }
+    fwrite(scratch, 1, out - scratch, fp);
+
+    fprintf(fp, "\nSCALARS species int 1\nLOOKUP_TABLE default\n");
+    out = scratch;
+    for (int i = 0; i < n; i++) {
+        int32_t species = objects[i].color;
+        out = putBigEndian(out, &species);
+    }
+    fwrite(scratch, 1, out - scratch, fp);
+
+    fprintf(fp, "\nSCALARS radius float 1\nLOOKUP_TABLE default\n");
+    out = scratch;
+    for (int i = 0; i < n; i++) {
+        float radius = objects[i].radius;
+        out = putBigEndian(out, &radius);
+    }
+    fwrite(scratch, 1, out - scratch, fp);
+    fprintf(fp, "\n");
+}
+
+static void writePLY(FILE* fp, const ExportBuffer* buffer, unsigned char* scratch)
+{
+    fprintf(fp, "ply\nformat binary_little_endian 1.0\ncomment verlet step %lu\n", buffer->step);
+    fprintf(fp, "element vertex %d\n", buffer->count);
+    fprintf(fp, "property float x\nproperty float y\nproperty float z\n");
+    fprintf(fp, "property float speed\nproperty uchar species\nproperty float radius\nend_header\n");
+
+    // Packed records; every target this builds on is little endian
+    unsigned char* out = scratch;
+    for (int i = 0; i < buffer->count; i++) {
+        const VerletObject* obj = &buffer->objects[i];
+        float record[4] = { obj->current[0], obj->current[1], obj->current[2],
+            vec3_distance((mfloat_t*)obj->current, (mfloat_t*)obj->previous) };
+        float radius = obj->radius;
+        memcpy(out, record, sizeof(record));
+        out += sizeof(record);
+        *out++ = (unsigned char)obj->color;
+        memcpy(out, &radius, sizeof(radius));
+        out += sizeof(radius);
+    }
+    fwrite(scratch, 1, out - scratch, fp);
+}
+
+static void writeXYZ(FILE* fp, const ExportBuffer* buffer)
+{
+    fprintf(fp, "%d\n", buffer->count);
+    fprintf(fp, "Properties=species:S:1:pos:R:3:speed:R:1:radius:R:1 Step=%lu\n", buffer->step);
+    for (int i = 0; i < buffer->count; i++) {
+        const VerletObject* obj = &buffer->objects[i];
+        fprintf(fp, "%s %.6f %.6f %.6f %.6g %.6f\n", speciesNames[obj->color],
+            obj->current[0], obj->current[1], obj->current[2],
+            vec3_distance((mfloat_t*)obj->current, (mfloat_t*)obj->previous), obj->radius);
+    }
+}
+
+static void writeBuffer(Exporter* exporter, const ExportBuffer* buffer, unsigned char* scratch)
+{
+    char path[300];
+    snprintf(path, sizeof(path), "%s/particles_%06lu.%s", exporter->directory, buffer->step, extensions[exporter->format]);
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("Couldn't open file %s\n", path);
+        return;
+    }
+    switch (exporter->format) {
+    case EXPORT_VTK:
+        writeVTK(fp, buffer, scratch);
+        break;
+    case EXPORT_PLY:
+        writePLY(fp, buffer, scratch);
+        break;
+    case EXPORT_XYZ:
+        writeXYZ(fp, buffer);
+        break;
+    }
+    fclose(fp);
+}
+
+static void* writerLoop(void* arg)
+{
+    Exporter* exporter = arg;
+    // Large enough for the biggest binary section (VTK vertices, PLY records)
+    unsigned char* scratch = malloc((size_t)exporter->capacity * 21);
+
+    pthread_mutex_lock(&exporter->lock);
+    for (;;) {
+        // Oldest ready step first
+        ExportBuffer* next = NULL;
+        for (int b = 0; b < EXPORT_BUFFERS; b++) {
+            ExportBuffer* buffer = &exporter->buffers[b];
+            if (buffer->state == EXPORT_READY && (next == NULL || buffer->step < next->step)) {
+                next = buffer;
+            }
+        }
+        if (next == NULL) {
+            if (exporter->stopping) {
+                break;
+            }
+            pthread_cond_wait(&exporter->filled, &exporter->lock);
+            continue;
+        }
+        next->state = EXPORT_WRITING;
+        pthread_mutex_unlock(&exporter->lock);
+
+        writeBuffer(exporter, next, scratch);
+
+        pthread_mutex_lock(&exporter->lock);
+        next->state = EXPORT_FREE;
+        exporter->written++;
+    }
+    pthread_mutex_unlock(&exporter->lock);
+
+    free(scratch);
+    return NULL;
+}
+
+Exporter* createExporter(const char* directory, ExportFormat format, int every, int capacity)
+{
+    Exporter* exporter = malloc(sizeof(Exporter));
+    memset(exporter, 0, sizeof(Exporter));
+    exporter->format = format;
+    exporter->every = every > 0 ? every : 1;
+    exporter->capacity = capacity;
+    snprintf(exporter->directory, sizeof(exporter->directory), "%s", directory);
+    mkdir(exporter->directory, 0755);
+
+    for (int b = 0; b < EXPORT_BUFFERS; b++) {
+        exporter->buffers[b].objects = malloc(sizeof(VerletObject) * capacity);
+        exporter->buffers[b].state = EXPORT_FREE;
+    }
+    pthread_mutex_init(&exporter->lock, NULL);
+    pthread_cond_init(&exporter->filled, NULL);
+    pthread_create(&exporter->writer, NULL, writerLoop, exporter);
+    return exporter;
+}
+
+void destroyExporter(Exporter* exporter)
+{
+    pthread_mutex_lock(&exporter->lock);
+    exporter->stopping = true;
+    pthread_cond_signal(&exporter->filled);
+    pthread_mutex_unlock(&exporter->lock);
+    pthread_join(exporter->writer, NULL);
+    printf("Exported %d steps to %s, %d skipped\n", exporter->written, exporter->directory, exporter->dropped);
+
+    for (int b = 0; b < EXPORT_BUFFERS; b++) {
+        free(exporter->buffers[b].objects);
+    }
+    pthread_cond_destroy(&exporter->filled);
+    pthread_mutex_destroy(&exporter->lock);
+    free(exporter);
+}
+
+bool exportStep(Exporter* exporter, const ParticleStore* store, unsigned long step)
+{
+    if (step % exporter->every != 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&exporter->lock);
+    ExportBuffer* buffer = NULL;
+    for (int b = 0; b < EXPORT_BUFFERS && buffer == NULL; b++) {
+        if (exporter->buffers[b].state == EXPORT_FREE) {
+            buffer = &exporter->buffers[b];
+        }
+    }
+    if (buffer == NULL) {
+        exporter->dropped++;
+    }
+    pthread_mutex_unlock(&exporter->lock);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    // A free buffer is never touched by the writer
+    int count = store->count < exporter->capacity ? store->count : exporter->capacity;
+    memcpy(buffer->objects, store->objects, sizeof(VerletObject) * count);
+    buffer->count = count;
+    buffer->step = step;
+
+    pthread_mutex_lock(&exporter->lock);
+    buffer->state = EXPORT_READY;
+    pthread_cond_signal(&exporter->filled);
+    pthread_mutex_unlock(&exporter->lock);
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef __EXPORT_H__
+#define __EXPORT_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "particles.h"
+
+#define EXPORT_BUFFERS 2 // One being written while the simulation fills the other
+
+typedef enum {
+    EXPORT_VTK, // Legacy VTK polydata, binary
+    EXPORT_PLY, // Binary little endian
+    EXPORT_XYZ, // Extended XYZ text
+} ExportFormat;
+
+typedef enum {
+    EXPORT_FREE,
+    EXPORT_READY,   // Filled, waiting for the writer
+    EXPORT_WRITING,
+} ExportState;
+
+typedef struct {
+    VerletObject* objects;
+    int count;
+    unsigned long step;
+    ExportState state;
+} ExportBuffer;
+
+// Writes every Nth step as one file per step for ParaView and friends:
+// position, speed (vec3_distance(current, previous), as the renderer uses),
+// species and radius. The simulation thread only copies the particles into a
+// free staging buffer; formatting and I/O happen on a background thread.
+typedef struct {
+    ExportFormat format;
+    char directory[256];
+    int every;
+    int capacity;
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t filled; // Writer has work or should stop
+    ExportBuffer buffers[EXPORT_BUFFERS];
+    bool stopping;
+    int written;
+    int dropped; // Due steps skipped because both buffers were busy
+} Exporter;
+
+// Returns false for an unknown name (vtk, ply or xyz)
+bool parseExportFormat(const char* name, ExportFormat* format);
+
+Exporter* createExporter(const char* directory, ExportFormat format, int every, int capacity);
+// Writes the staged steps, joins the writer and prints a summary
+void destroyExporter(Exporter* exporter);
+
+// Stage the store if step is due. Never waits: returns false when the step is
+// not due or no buffer is free.
+bool exportStep(Exporter* exporter, const ParticleStore* store, unsigned long step);
+
+#endif
@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200809L // dup, fdopen, mkdir
+
+#include "framedump.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define FENCE_TIMEOUT 1000000000 // 1 second in nanoseconds
+
+static void writeFrame(FrameDump* dump, const DumpedFrame* frame, unsigned char* row)
+{
+    FILE* fp = dump->pipe;
+    if (fp == NULL) {
+        char path[300];
+        snprintf(path, sizeof(path), "%s/frame_%06d.ppm", dump->directory, frame->index);
+        fp = fopen(path, "wb");
+        if (fp == NULL) {
+            printf("Couldn't open file %s\n", path);
+            return;
+        }
+        fprintf(fp, "P6\n%d %d\n255\n", dump->width, dump->height);
+    }
+
+    // GL rows start at the bottom, images at the top; drop alpha on the way
+    for (int y = dump->height - 1; y >= 0; y--) {
+        const unsigned char* src = frame->pixels + (size_t)y * dump->width * 4;
+        for (int x = 0; x < dump->width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        fwrite(row, 3, dump->width, fp);
+    }
+
+    if (fp == dump->pipe) {
+        fflush(fp);
+    } else {
+        fclose(fp);
+    }
+}
+
+static void* encoderLoop(void* arg)
+{
+    FrameDump* dump = arg;
+    unsigned char* row = malloc((size_t)dump->width * 3);
+
+    pthread_mutex_lock(&dump->lock);
+    for (;;) {
+        while (dump->count == 0 && !dump->stopping) {
+            pthread_cond_wait(&dump->filled, &dump->lock);
+        }
+        if (dump->count == 0) {
+            break;
+        }
+        // The slot stays owned by the encoder until count drops
+        DumpedFrame* frame = &dump->queue[dump->head];
+        pthread_mutex_unlock(&dump->lock);
+
+        writeFrame(dump, frame, row);
+
+        pthread_mutex_lock(&dump->lock);
+        dump->head = (dump->head + 1) % FRAMEDUMP_QUEUE;
+        dump->count--;
+        pthread_cond_signal(&dump->drained);
+    }
+    pthread_mutex_unlock(&dump->lock);
+
+    free(row);
+    return NULL;
+}
+
+FrameDump* createFrameDump(int width, int height, const char* output)
+{
+    FrameDump* dump = malloc(sizeof(FrameDump));
+    memset(dump, 0, sizeof(FrameDump));
+    dump->width = width;
+    dump->height = height;
+    if (strcmp(output, "-") == 0) {
+        // Keep the real stdout for frames and send every printf to stderr
+        fflush(stdout);
+        dump->pipe = fdopen(dup(STDOUT_FILENO), "wb");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    } else {
+        snprintf(dump->directory, sizeof(dump->directory), "%s", output);
+        mkdir(dump->directory, 0755);
+    }
+
+    // Color and depth targets standing in for the window's framebuffer
+    glGenRenderbuffers(1, &(dump->colorRBO));
+    glBindRenderbuffer(GL_RENDERBUFFER, dump->colorRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &(dump->depthRBO));
+    glBindRenderbuffer(GL_RENDERBUFFER, dump->depthRBO);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &(dump->FBO));
+    glBindFramebuffer(GL_FRAMEBUFFER, dump->FBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, dump->colorRBO);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, dump->depthRBO);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        printf("Frame dump: incomplete framebuffer\n");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    size_t frameSize = (size_t)width * height * 4;
+    glGenBuffers(FRAMEDUMP_PBOS, dump->PBOs);
+    for (int i = 0; i < FRAMEDUMP_PBOS; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, dump->PBOs[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    for (int i = 0; i < FRAMEDUMP_QUEUE; i++) {
+        dump->queue[i].pixels = malloc(frameSize);
+    }
+    pthread_mutex_init(&dump->lock, NULL);
+    pthread_cond_init(&dump->filled, NULL);
+    pthread_cond_init(&dump->drained, NULL);
+    pthread_create(&dump->encoder, NULL, encoderLoop, dump);
+    return dump;
+}
+
+// Wait for a read-back, copy it into the encoder queue and free the PBO
+static void retireSlot(FrameDump* dump, int slot)
+{
+    while (glClientWaitSync(dump->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT) == GL_TIMEOUT_EXPIRED) {
+        // Keep waiting
+    }
+    glDeleteSync(dump->fences[slot]);
+    dump->fences[slot] = NULL;
+
+    size_t frameSize = (size_t)dump->width * dump->height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, dump->PBOs[slot]);
+    const unsigned char* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+    if (pixels) {
+        pthread_mutex_lock(&dump->lock);
+        // Only blocks when the disk falls FRAMEDUMP_QUEUE frames behind
+        while (dump->count == FRAMEDUMP_QUEUE) {
+            pthread_cond_wait(&dump->drained, &dump->lock);
+        }
+        DumpedFrame* frame = &dump->queue[(dump->head + dump->count) % FRAMEDUMP_QUEUE];
+        pthread_mutex_unlock(&dump->lock);
+
+        // The encoder never touches slots past head + count
+        memcpy(frame->pixels, pixels, frameSize);
+        frame->index = dump->pboFrames[slot];
+
+        pthread_mutex_lock(&dump->lock);
+        dump->count++;
+        pthread_cond_signal(&dump->filled);
+        pthread_mutex_unlock(&dump->lock);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void bindFrameDump(FrameDump* dump)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, dump->FBO);
+    glViewport(0, 0, dump->width, dump->height);
+}
+
+void captureFrame(FrameDump* dump)
+{
+    int slot = dump->next;
+    if (dump->fences[slot]) {
+        retireSlot(dump, slot);
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, dump->FBO);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, dump->PBOs[slot]);
+    glReadPixels(0, 0, dump->width, dump->height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    dump->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    dump->pboFrames[slot] = dump->frame++;
+    dump->next = (slot + 1) % FRAMEDUMP_PBOS;
+}
+
+void destroyFrameDump(FrameDump* dump)
+{
+    // Oldest first so frames reach the encoder in order
+    for (int i = 0; i < FRAMEDUMP_PBOS; i++) {
+        int slot = (dump->next + i) % FRAMEDUMP_PBOS;
+        if (dump->fences[slot]) {
+            retireSlot(dump, slot);
+        }
+    }
+
+    pthread_mutex_lock(&dump->lock);
+    dump->stopping = true;
+    pthread_cond_signal(&dump->filled);
+    pthread_mutex_unlock(&dump->lock);
+    pthread_join(dump->encoder, NULL);
+    if (dump->pipe) {
+        fclose(dump->pipe);
+    }
+
+    for (int i = 0; i < FRAMEDUMP_QUEUE; i++) {
+        free(dump->queue[i].pixels);
+    }
+    pthread_cond_destroy(&dump->filled);
+    pthread_cond_destroy(&dump->drained);
+    pthread_mutex_destroy(&dump->lock);
+    glDeleteBuffers(FRAMEDUMP_PBOS, dump->PBOs);
+    glDeleteFramebuffers(1, &(dump->FBO));
+    glDeleteRenderbuffers(1, &(dump->colorRBO));
+    glDeleteRenderbuffers(1, &(dump->depthRBO));
+    free(dump);
+}
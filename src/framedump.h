@@ -0,0 +1,57 @@
+#ifndef __FRAMEDUMP_H__
+#define __FRAMEDUMP_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <GL/glew.h>
+
+#define FRAMEDUMP_PBOS 3  // Read-backs in flight before the oldest is mapped
+#define FRAMEDUMP_QUEUE 8 // Frames buffered for the encoder thread
+
+typedef struct {
+    unsigned char* pixels; // RGBA, bottom row first as read from GL
+    int index;
+} DumpedFrame;
+
+// Offscreen render target whose frames are read back through a ring of pixel
+// buffer objects and written out by a background encoder thread, either as
+// numbered PPM files or as raw RGB24 frames on stdout (for piping into ffmpeg).
+typedef struct {
+    int width;
+    int height;
+    unsigned int FBO;
+    unsigned int colorRBO;
+    unsigned int depthRBO;
+    unsigned int PBOs[FRAMEDUMP_PBOS];
+    GLsync fences[FRAMEDUMP_PBOS];
+    int pboFrames[FRAMEDUMP_PBOS];
+    int next;
+    int frame;
+
+    pthread_t encoder;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;  // Encoder has work or should stop
+    pthread_cond_t drained; // A queue slot was freed
+    DumpedFrame queue[FRAMEDUMP_QUEUE];
+    int head;
+    int count;
+    bool stopping;
+    FILE* pipe;          // stdout for raw output, NULL for PPM files
+    char directory[256]; // Where PPM files go
+} FrameDump;
+
+// output is a directory for PPM files, or "-" for raw RGB24 on stdout
+FrameDump* createFrameDump(int width, int height, const char* output);
+// Flushes every pending frame to the encoder and waits for it to finish
+void destroyFrameDump(FrameDump* dump);
+
+// Render into the dump's framebuffer
+void bindFrameDump(FrameDump* dump);
+
+// Start reading back the finished frame; hands the frame read
+// FRAMEDUMP_PBOS - 1 captures ago to the encoder
+void captureFrame(FrameDump* dump);
+
+#endif
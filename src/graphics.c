@@ -6,7 +6,37 @@
 
 #include "graphics.h"
 
-void drawMesh(Mesh* mesh, unsigned int shaderID, GLenum mode, mfloat_t* position, mfloat_t* rotation, mfloat_t scale)
+mfloat_t* createProjectionMatrix(mfloat_t* projection, float aspect)
+{
+    return mat4_perspective(projection, to_radians(FIELD_OF_VIEW), aspect, NEAR_PLANE, FAR_PLANE);
+}
+
+unsigned int createCameraBuffer()
+{
+    unsigned int buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    // std140: two column-major mat4, view then projection
+    glBufferData(GL_UNIFORM_BUFFER, 2 * MAT4_SIZE * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, buffer);
+    return buffer;
+}
+
+void updateCameraBuffer(unsigned int buffer, mfloat_t* view, mfloat_t* projection)
+{
+    float matrices[2 * MAT4_SIZE];
+    memcpy(matrices, view, MAT4_SIZE * sizeof(float));
+    memcpy(matrices + MAT4_SIZE, projection, MAT4_SIZE * sizeof(float));
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(matrices), matrices);
+}
+
+void destroyCameraBuffer(unsigned int buffer)
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+void drawMesh(Mesh* mesh, const ShaderProgram* shader, GLenum mode, mfloat_t* position, mfloat_t* rotation, mfloat_t scale)
 {
     mfloat_t scaling[VEC3_SIZE] = { scale, scale, scale };
 
@@ -33,45 +63,33 @@ void drawMesh(Mesh* mesh, unsigned int shaderID, GLenum mode, mfloat_t* position
     mat4_multiply(matrices.model, matrices.rotation, matrices.scaling);
     mat4_multiply(matrices.model, matrices.position, matrices.model);
 
-    glUseProgram(shaderID);
+    useShader(shader);
 
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "model"),
+    glUniformMatrix4fv(shader->uniforms[UNIFORM_MODEL],
         1, GL_FALSE, matrices.model);
 
-    mfloat_t projection[MAT4_SIZE];
-
-    mat4_perspective(projection, to_radians(45.0), (float)1280 / (float)720, 0.1, 100.0);
-
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "projection"),
-        1, GL_FALSE, projection);
-
     glBindVertexArray(mesh->VAO);
 
-    glDrawArrays(mode, 0, mesh->numVertices);
-
-    glUseProgram(0);
+    if (mesh->numIndices > 0 && mode != GL_POINTS) {
+        glDrawElements(mode, mesh->numIndices, GL_UNSIGNED_INT, (void*)0);
+    } else {
+        glDrawArrays(mode, 0, mesh->numVertices);
+    }
 
     glBindVertexArray(0);
 }
 
-void drawInstanced(Mesh* mesh, unsigned int shaderID, GLenum mode, int num, mfloat_t scale)
+void drawInstanced(Mesh* mesh, const ShaderProgram* shader, GLenum mode, int num)
 {
-    glUseProgram(shaderID);
-
-    mfloat_t projection[MAT4_SIZE];
-
-    mat4_perspective(projection, to_radians(45.0), (float)1280 / (float)720, 0.1, 100.0);
-
-    glUniformMatrix4fv(glGetUniformLocation(shaderID, "projection"),
-        1, GL_FALSE, projection);
-
-    glUniform1f(glGetUniformLocation(shaderID, "scale"), scale);
+    useShader(shader);
 
     glBindVertexArray(mesh->VAO);
 
-    glDrawArraysInstanced(mode, 0, mesh->numVertices, num);
-
-    glUseProgram(0);
+    if (mesh->numIndices > 0) {
+        glDrawElementsInstanced(mode, mesh->numIndices, GL_UNSIGNED_INT, (void*)0, num);
+    } else {
+        glDrawArraysInstanced(mode, 0, mesh->numVertices, num);
+    }
 
     glBindVertexArray(0);
 }
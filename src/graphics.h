@@ -2,9 +2,21 @@
 #define __GRAPHICS_H__
 
 #include "model.h"
+#include "shader.h"
 #include "mathc.h"
 
-void drawMesh(Mesh* mesh, unsigned int shaderID, GLenum mode, mfloat_t* position, mfloat_t* rotation, mfloat_t scale);
-void drawInstanced(Mesh* mesh, unsigned int shaderID, GLenum mode, int num, mfloat_t scale);
+#define FIELD_OF_VIEW 45.0
+#define NEAR_PLANE 0.1
+#define FAR_PLANE 100.0
+
+mfloat_t* createProjectionMatrix(mfloat_t* projection, float aspect);
+
+// std140 buffer behind the Camera uniform block, bound at CAMERA_BINDING
+unsigned int createCameraBuffer();
+void updateCameraBuffer(unsigned int buffer, mfloat_t* view, mfloat_t* projection);
+void destroyCameraBuffer(unsigned int buffer);
+
+void drawMesh(Mesh* mesh, const ShaderProgram* shader, GLenum mode, mfloat_t* position, mfloat_t* rotation, mfloat_t scale);
+void drawInstanced(Mesh* mesh, const ShaderProgram* shader, GLenum mode, int num);
 
 #endif
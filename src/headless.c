@@ -0,0 +1,109 @@
+#include "headless.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <EGL/eglext.h>
+
+static bool hasExtension(const char* extensions, const char* name)
+{
+    if (extensions == NULL) {
+        return false;
+    }
+    size_t length = strlen(name);
+    for (const char* at = strstr(extensions, name); at; at = strstr(at + length, name)) {
+        bool start = at == extensions || at[-1] == ' ';
+        bool end = at[length] == ' ' || at[length] == '\0';
+        if (start && end) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static EGLDisplay openDisplay()
+{
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            if (display != EGL_NO_DISPLAY) {
+                return display;
+            }
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+bool createHeadlessContext(HeadlessContext* headless)
+{
+    headless->display = openDisplay();
+    headless->context = EGL_NO_CONTEXT;
+    headless->surface = EGL_NO_SURFACE;
+    if (headless->display == EGL_NO_DISPLAY || !eglInitialize(headless->display, NULL, NULL)) {
+        printf("Headless: no EGL display\n");
+        return false;
+    }
+
+    // Rendering goes to an FBO, the config only has to support desktop GL
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(headless->display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+        printf("Headless: no suitable EGL config\n");
+        destroyHeadlessContext(headless);
+        return false;
+    }
+
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    headless->context = eglCreateContext(headless->display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (headless->context == EGL_NO_CONTEXT) {
+        printf("Headless: could not create an OpenGL 3.3 core context\n");
+        destroyHeadlessContext(headless);
+        return false;
+    }
+
+    const char* displayExtensions = eglQueryString(headless->display, EGL_EXTENSIONS);
+    if (!hasExtension(displayExtensions, "EGL_KHR_surfaceless_context")) {
+        const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        headless->surface = eglCreatePbufferSurface(headless->display, config, pbufferAttributes);
+    }
+    if (!eglMakeCurrent(headless->display, headless->surface, headless->surface, headless->context)) {
+        printf("Headless: eglMakeCurrent failed\n");
+        destroyHeadlessContext(headless);
+        return false;
+    }
+    return true;
+}
+
+void destroyHeadlessContext(HeadlessContext* headless)
+{
+    if (headless->display == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(headless->display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (headless->surface != EGL_NO_SURFACE) {
+        eglDestroySurface(headless->display, headless->surface);
+    }
+    if (headless->context != EGL_NO_CONTEXT) {
+        eglDestroyContext(headless->display, headless->context);
+    }
+    eglTerminate(headless->display);
+    headless->display = EGL_NO_DISPLAY;
+}
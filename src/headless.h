@@ -0,0 +1,21 @@
+#ifndef __HEADLESS_H__
+#define __HEADLESS_H__
+
+#include <stdbool.h>
+
+#include <EGL/egl.h>
+
+// OpenGL 3.3 core context without any window system. Uses the Mesa
+// surfaceless platform when available (works with llvmpipe on machines
+// without a display) and falls back to a 1x1 pbuffer on the default display.
+typedef struct {
+    EGLDisplay display;
+    EGLContext context;
+    EGLSurface surface; // EGL_NO_SURFACE when surfaceless
+} HeadlessContext;
+
+// Creates the context and makes it current
+bool createHeadlessContext(HeadlessContext* headless);
+void destroyHeadlessContext(HeadlessContext* headless);
+
+#endif
@@ -1,5 +1,8 @@
 #include "hud.h"
 
+#include <float.h>
+#include <stdio.h>
+
 // Ensure GLEW is the GL loader and include it before any other GL headers
 #ifndef IMGUI_IMPL_OPENGL_LOADER_GLEW
 #define IMGUI_IMPL_OPENGL_LOADER_GLEW
@@ -54,14 +57,127 @@ static void set_view_z(Camera* camera, float radius)
     camera->position[0] = 0.0f; camera->position[1] = 0.0f; camera->position[2] = radius;
 }
 
-void hud_update(float fps, int numActive, bool* clearRequested,
-                Camera* camera, float* cameraRadius, bool* autoOrbit)
+#ifdef PROFILER
+// Zone colours, in ProfileZone order: simulation warm, render cool
+static const ImU32 zone_colors[PROFILE_ZONES] = {
+    IM_COL32(230, 85, 70, 255),   // forces
+    IM_COL32(240, 160, 60, 255),  // grid
+    IM_COL32(230, 215, 80, 255),  // collisions
+    IM_COL32(130, 200, 90, 255),  // constraints
+    IM_COL32(70, 180, 160, 255),  // integration
+    IM_COL32(80, 140, 230, 255),  // pack
+    IM_COL32(140, 110, 230, 255), // upload
+    IM_COL32(210, 100, 200, 255), // draw
+    IM_COL32(170, 170, 170, 255), // hud
+    IM_COL32(100, 100, 100, 255), // swap
+};
+
+static void profiler_window(const ProfileReport* report, bool* traceRequested)
+{
+    static bool slowest = false;
+
+    ImGui::Begin("Profiler");
+    if (report->tracing) {
+        ImGui::Text("Tracing...");
+    } else if (traceRequested && ImGui::Button("Capture trace (F8)")) {
+        *traceRequested = true;
+    }
+    for (int w = 0; w < PROFILE_WINDOWS; w++) {
+        ImGui::Text("Frame p50 %.2f | p99 %.2f ms over %.0f s (%d frames)", report->frameP50[w],
+                    report->frameP99[w], profileWindowSeconds[w], report->frames[w]);
+    }
+    ImGui::Checkbox("Slowest frame of the last 10 s", &slowest);
+    if (slowest) {
+        ImGui::SameLine();
+        ImGui::Text("%.2f ms", report->slowestFrameMs);
+    }
+
+    // One stacked bar per thread, all to the scale of a whole frame
+    const float (*ms)[PROFILE_ZONES] = slowest ? report->slowestMs : report->meanMs;
+    float scale = slowest ? report->slowestFrameMs : report->frameP50[0];
+    for (int t = 0; t < PROFILE_TRACKS; t++) {
+        float total = 0.0f;
+        for (int z = 0; z < PROFILE_ZONES; z++) {
+            total += ms[t][z];
+        }
+        if (total > scale) scale = total;
+    }
+    const float labelWidth = 80.0f;
+    float width = ImGui::GetContentRegionAvail().x - labelWidth;
+    float height = ImGui::GetTextLineHeight();
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    for (int t = 0; t < PROFILE_TRACKS; t++) {
+        char name[32];
+        profileTrackName(t, name, sizeof(name));
+        ImGui::Text("%s", name);
+        ImGui::SameLine(labelWidth);
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float x = origin.x;
+        for (int z = 0; z < PROFILE_ZONES && scale > 0.0f; z++) {
+            float w = ms[t][z] / scale * width;
+            if (w > 0.0f) {
+                drawList->AddRectFilled(ImVec2(x, origin.y), ImVec2(x + w, origin.y + height), zone_colors[z]);
+            }
+            x += w;
+        }
+        ImGui::Dummy(ImVec2(width, height));
+        if (ImGui::IsItemHovered()) {
+            ImGui::BeginTooltip();
+            for (int z = 0; z < PROFILE_ZONES; z++) {
+                if (ms[t][z] > 0.0f) {
+                    ImGui::Text("%-12s %.3f ms", profileZoneNames[z], ms[t][z]);
+                }
+            }
+            ImGui::EndTooltip();
+        }
+    }
+    for (int z = 0; z < PROFILE_ZONES; z++) {
+        if (z % 5) ImGui::SameLine();
+        ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(zone_colors[z]), "%s", profileZoneNames[z]);
+    }
+
+    ImGui::Separator();
+    for (int w = 0; w < PROFILE_WINDOWS; w++) {
+        char label[16], overlay[32];
+        snprintf(label, sizeof(label), "%.0f s", profileWindowSeconds[w]);
+        snprintf(overlay, sizeof(overlay), "0 - %.1f ms", report->binMs * PROFILE_BINS);
+        ImGui::PlotHistogram(label, report->histogram[w], PROFILE_BINS, 0, overlay, 0.0f, FLT_MAX, ImVec2(0, 50));
+    }
+
+    if (ImGui::BeginTable("zones", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("zone (ms)");
+        ImGui::TableSetupColumn("p50 1s");
+        ImGui::TableSetupColumn("p99 1s");
+        ImGui::TableSetupColumn("p50 10s");
+        ImGui::TableSetupColumn("p99 10s");
+        ImGui::TableHeadersRow();
+        for (int z = 0; z < PROFILE_ZONES; z++) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(zone_colors[z]), "%s", profileZoneNames[z]);
+            for (int w = 0; w < PROFILE_WINDOWS; w++) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", report->zoneP50[w][z]);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.3f", report->zoneP99[w][z]);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+#endif
+
+void hud_update(const HudStats* stats, bool* clearRequested,
+                Camera* camera, float* cameraRadius, bool* autoOrbit, bool* impostors,
+                bool* frustumCull, bool* occlusionCull, HudPlayback* playback, bool* traceRequested)
 {
     if (clearRequested) *clearRequested = false;
+    if (traceRequested) *traceRequested = false;
 
     ImGui::Begin("HUD");
-    ImGui::Text("FPS: %.1f", fps);
-    ImGui::Text("Balls: %d", numActive);
+    ImGui::Text("FPS: %.1f", stats->fps);
+    ImGui::Text("Balls: %d", stats->numActive);
     if (clearRequested && ImGui::Button("Clear (accel+vel)")) {
         *clearRequested = true;
     }
@@ -72,6 +188,33 @@ void hud_update(float fps, int numActive, bool* clearRequested,
     if (cameraRadius) {
         ImGui::SliderFloat("Camera Radius", cameraRadius, 5.0f, 100.0f, "%.1f");
     }
+    if (impostors) {
+        ImGui::Checkbox("Sphere Impostors", impostors);
+    }
+    if (frustumCull) {
+        ImGui::Checkbox("Frustum Culling", frustumCull);
+    }
+    if (occlusionCull) {
+        ImGui::Checkbox("Occlusion Culling", occlusionCull);
+    }
+    if (playback && playback->active) {
+        ImGui::Separator();
+        ImGui::Checkbox("Pause", &playback->paused);
+        ImGui::SliderInt("Frame", &playback->frame, 0, playback->numFrames - 1);
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Frame (ms)");
+    ImGui::Text("Sim %.2f | Pack %.2f | Upload %.2f | Draw %.2f",
+                stats->simMs, stats->packMs, stats->uploadMs, stats->drawMs);
+    ImGui::Text("Pacing jitter %.3f | max %.3f", stats->jitterMs, stats->maxJitterMs);
+    ImGui::Text("LOD %d / %d / %d / %d", stats->lodCounts[0], stats->lodCounts[1],
+                stats->lodCounts[2], stats->lodCounts[3]);
+    ImGui::Text("Frustum culled: %d | Occluded: %d", stats->frustumCulled, stats->occlusionCulled);
+    if (stats->recording) {
+        ImGui::Text("Recording x%.1f | backlog %d | dropped %d", stats->recordRatio,
+                    stats->recordBacklog, stats->recordDropped);
+    }
 
     ImGui::Separator();
     ImGui::Text("Views");
@@ -84,6 +227,12 @@ void hud_update(float fps, int numActive, bool* clearRequested,
     if (ImGui::Button("Orbit")) { if (autoOrbit) *autoOrbit = true; }
 
     ImGui::End();
+
+#ifdef PROFILER
+    if (stats->profile) {
+        profiler_window(stats->profile, traceRequested);
+    }
+#endif
 }
 
 void hud_render(void)
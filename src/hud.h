@@ -3,6 +3,8 @@
 
 #include <stdbool.h>
 #include "camera.h"
+#include "instances.h"
+#include "profiler.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -11,6 +13,34 @@ extern "C" {
 // Forward declaration to avoid including GLFW headers here
 typedef struct GLFWwindow GLFWwindow;
 
+// Per-frame numbers shown by the HUD. Phase timings are in milliseconds.
+typedef struct {
+    float fps;
+    int numActive;
+    float simMs;    // substeps
+    float packMs;   // filling the instance buffer
+    float uploadMs; // instance stream wait + transfer
+    float drawMs;   // draw call submission
+    float jitterMs;    // mean lateness of frame wake-ups
+    float maxJitterMs; // worst lateness in the last report window
+    int lodCounts[NUM_LODS];
+    int frustumCulled;
+    int occlusionCulled;
+    bool recording;
+    float recordRatio;   // Trajectory compression
+    int recordBacklog;   // Frames queued for the trajectory writer
+    int recordDropped;
+    const ProfileReport* profile; // Shown in its own window on PROFILER builds
+} HudStats;
+
+// Trajectory playback controls; frame is written back when the user scrubs
+typedef struct {
+    bool active;
+    bool paused;
+    int frame;
+    int numFrames;
+} HudPlayback;
+
 // Initialize Dear ImGui for a GLFW + OpenGL3 context
 void hud_init(GLFWwindow* window);
 
@@ -18,12 +48,17 @@ void hud_init(GLFWwindow* window);
 void hud_new_frame(void);
 
 // Build/update the HUD UI. This does not render; it only updates state based on UI.
-// - fps: current frames per second
-// - numActive: current number of active particles
+// - stats: frame rate, particle count and frame-phase timings
 // - clearRequested: set to true when the user presses the Clear button
 // - camera/cameraRadius/autoOrbit: can be modified by UI buttons to change view
-void hud_update(float fps, int numActive, bool* clearRequested,
-                Camera* camera, float* cameraRadius, bool* autoOrbit);
+// - impostors: toggles ray-cast sphere impostors vs. instanced sphere meshes
+// - frustumCull: toggles dropping off-screen particles before upload
+// - occlusionCull: toggles dropping particles hidden behind last frame's depth
+// - playback: pause and scrub controls while a trajectory is playing
+// - traceRequested: set to true when the user asks for a trace capture
+void hud_update(const HudStats* stats, bool* clearRequested,
+                Camera* camera, float* cameraRadius, bool* autoOrbit, bool* impostors,
+                bool* frustumCull, bool* occlusionCull, HudPlayback* playback, bool* traceRequested);
 
 // Render the HUD (call once per frame after your 3D rendering, before buffer swap)
 void hud_render(void);
@@ -0,0 +1,343 @@
+#include "inputlog.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "varint.h"
+
+#define INPUTLOG_CHECKSUM 0xFE // Record entries that are not SimCommandTypes
+#define INPUTLOG_END 0xFF
+#define MAX_ENTRY 128          // Largest fixed-size entry
+
+static bool changesState(SimCommandType type)
+{
+    return type != SIM_PICK && type != SIM_SAVE;
+}
+
+static unsigned char* putFloats(unsigned char* out, const mfloat_t* values, int n)
+{
+    for (int i = 0; i < n; i++) {
+        float value = values[i];
+        memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+    }
+    return out;
+}
+
+static const unsigned char* getFloats(const unsigned char* in, mfloat_t* values, int n)
+{
+    for (int i = 0; i < n; i++) {
+        float value;
+        memcpy(&value, in, sizeof(value));
+        values[i] = value;
+        in += sizeof(value);
+    }
+    return in;
+}
+
+static void writeEntry(InputLog* log, const SimCommand* command)
+{
+    unsigned char entry[MAX_ENTRY];
+    unsigned char* out = entry;
+    *out++ = (unsigned char)command->type;
+    switch (command->type) {
+    case SIM_INSERT: {
+        const VerletObject* obj = &command->object;
+        out = putFloats(out, obj->current, VEC3_SIZE);
+        out = putFloats(out, obj->previous, VEC3_SIZE);
+        out = putFloats(out, obj->acceleration, VEC3_SIZE);
+        out = putFloats(out, obj->colorVector, VEC3_SIZE);
+        out = putFloats(out, &obj->radius, 1);
+        out = putFloats(out, &obj->mass, 1);
+        out = putFloats(out, &obj->lifetime, 1);
+        *out++ = (unsigned char)obj->color;
+        break;
+    }
+    case SIM_SPAWN:
+        out = putFloats(out, command->position, VEC3_SIZE);
+        out = putFloats(out, command->velocity, VEC3_SIZE);
+        out = putFloats(out, &command->radius, 1);
+        out = putFloats(out, &command->lifetime, 1);
+        *out++ = (unsigned char)command->color;
+        break;
+    case SIM_FORCE:
+    case SIM_ATTRACT:
+        out = putFloats(out, command->position, VEC3_SIZE);
+        out = putFloats(out, &command->strength, 1);
+        break;
+    case SIM_DRAIN:
+        out = putFloats(out, &command->radius, 1);
+        break;
+    case SIM_MOVE_CONTAINER:
+        out = putFloats(out, command->position, VEC3_SIZE);
+        break;
+    case SIM_DRAG:
+        out = putVarint(out, command->handle.slot);
+        out = putVarint(out, command->handle.generation);
+        out = putFloats(out, command->position, VEC3_SIZE);
+        break;
+    case SIM_LOAD: {
+        // Stored with its terminator so replay can point straight at it
+        size_t length = strlen(command->path) + 1;
+        out = putVarint(out, length);
+        fwrite(entry, 1, out - entry, log->file);
+        fwrite(command->path, 1, length, log->file);
+        return;
+    }
+    default:
+        break;
+    }
+    fwrite(entry, 1, out - entry, log->file);
+}
+
+// Parse the record at in. commands may be NULL to only walk it. Returns the
+// end of the record, or NULL if it runs past end or holds an unknown entry.
+static const unsigned char* readRecord(InputLog* log, const unsigned char* in, SimCommand* commands, int max, int* count, bool* isEnd)
+{
+    const unsigned char* end = log->data + log->size;
+    uint64_t numEntries, value;
+    in = getVarint(in, &numEntries);
+    *count = 0;
+    *isEnd = false;
+    log->expected = 0;
+
+    for (uint64_t e = 0; e < numEntries; e++) {
+        if (in >= end) {
+            return NULL;
+        }
+        int type = *in++;
+        if (type == INPUTLOG_END) {
+            *isEnd = true;
+            continue;
+        }
+        if (type == INPUTLOG_CHECKSUM) {
+            memcpy(&log->expected, in, sizeof(uint64_t));
+            in += sizeof(uint64_t);
+            continue;
+        }
+        SimCommand scratch;
+        SimCommand* command = commands && *count < max ? &commands[(*count)++] : &scratch;
+        memset(command, 0, sizeof(SimCommand));
+        command->type = type;
+        switch (type) {
+        case SIM_INSERT: {
+            VerletObject* obj = &command->object;
+            in = getFloats(in, obj->current, VEC3_SIZE);
+            in = getFloats(in, obj->previous, VEC3_SIZE);
+            in = getFloats(in, obj->acceleration, VEC3_SIZE);
+            in = getFloats(in, obj->colorVector, VEC3_SIZE);
+            in = getFloats(in, &obj->radius, 1);
+            in = getFloats(in, &obj->mass, 1);
+            in = getFloats(in, &obj->lifetime, 1);
+            obj->color = *in++;
+            break;
+        }
+        case SIM_SPAWN:
+            in = getFloats(in, command->position, VEC3_SIZE);
+            in = getFloats(in, command->velocity, VEC3_SIZE);
+            in = getFloats(in, &command->radius, 1);
+            in = getFloats(in, &command->lifetime, 1);
+            command->color = *in++;
+            break;
+        case SIM_FORCE:
+        case SIM_ATTRACT:
+            in = getFloats(in, command->position, VEC3_SIZE);
+            in = getFloats(in, &command->strength, 1);
+            break;
+        case SIM_CLEAR:
+            break;
+        case SIM_DRAIN:
+            in = getFloats(in, &command->radius, 1);
+            break;
+        case SIM_MOVE_CONTAINER:
+            in = getFloats(in, command->position, VEC3_SIZE);
+            break;
+        case SIM_DRAG:
+            in = getVarint(in, &value);
+            command->handle.slot = value;
+            in = getVarint(in, &value);
+            command->handle.generation = value;
+            in = getFloats(in, command->position, VEC3_SIZE);
+            break;
+        case SIM_LOAD:
+            in = getVarint(in, &value);
+            if (in > end || value == 0 || value > (uint64_t)(end - in) || in[value - 1] != '\0') {
+                return NULL;
+            }
+            command->path = (const char*)in;
+            in += value;
+            break;
+        default:
+            return NULL;
+        }
+    }
+    return in <= end ? in : NULL;
+}
+
+InputLog* createInputLog(const char* path, uint32_t seed)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Failed to create input log %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    InputLogHeader header = { INPUTLOG_MAGIC, INPUTLOG_VERSION, seed, SIM_SUBSTEPS, SIM_STEP };
+    fwrite(&header, sizeof(header), 1, file);
+
+    InputLog* log = malloc(sizeof(InputLog));
+    memset(log, 0, sizeof(InputLog));
+    log->file = file;
+    return log;
+}
+
+InputLog* openInputLog(const char* path, uint32_t* seed)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("Failed to open input log %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    InputLogHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != INPUTLOG_MAGIC || header.version != INPUTLOG_VERSION) {
+        printf("%s is not a version %d input log\n", path, INPUTLOG_VERSION);
+        fclose(file);
+        return NULL;
+    }
+    if (header.substeps != SIM_SUBSTEPS || header.step != SIM_STEP) {
+        printf("Input log %s was recorded at %g s x %u substeps; replay will diverge\n", path, header.step, header.substeps);
+    }
+
+    InputLog* log = malloc(sizeof(InputLog));
+    memset(log, 0, sizeof(InputLog));
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file) - sizeof(header);
+    fseek(file, sizeof(header), SEEK_SET);
+    // Zero padding lets a varint cut off at the end stop inside the buffer
+    log->data = calloc(size + MAX_ENTRY, 1);
+    log->size = fread(log->data, 1, size, file);
+    fclose(file);
+
+    // Walk the records once for the length of the run; a log cut short ends
+    // with its last complete record
+    const unsigned char* in = log->data;
+    const unsigned char* end = log->data + log->size;
+    unsigned long step = 0;
+    bool isEnd = false;
+    while (in < end && !isEnd) {
+        uint64_t delta;
+        int count;
+        const unsigned char* next = readRecord(log, getVarint(in, &delta), NULL, 0, &count, &isEnd);
+        if (next == NULL) {
+            printf("Input log %s is truncated after step %lu\n", path, step);
+            break;
+        }
+        step += delta;
+        in = next;
+    }
+    log->size = in - log->data;
+    log->endStep = step;
+    log->cursor = log->data;
+    log->nextStep = ULONG_MAX;
+    if (log->size > 0) {
+        uint64_t delta;
+        log->cursor = getVarint(log->cursor, &delta);
+        log->nextStep = delta;
+    }
+    *seed = header.seed;
+    return log;
+}
+
+void closeInputLog(InputLog* log)
+{
+    if (log->file) {
+        // Marks the last step so a replay knows where live input takes over
+        unsigned char entry[2 * MAX_VARINT + 1];
+        unsigned char* out = putVarint(entry, log->endStep - log->lastStep);
+        out = putVarint(out, 1);
+        *out++ = INPUTLOG_END;
+        fwrite(entry, 1, out - entry, log->file);
+        long bytes = ftell(log->file);
+        fclose(log->file);
+        printf("Logged input for %lu steps in %ld bytes\n", log->endStep, bytes);
+    }
+    free(log->data);
+    free(log);
+}
+
+uint64_t hashPositions(const ParticleStore* store)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < store->count; i++) {
+        const unsigned char* bytes = (const unsigned char*)store->objects[i].current;
+        for (size_t b = 0; b < sizeof(store->objects[i].current); b++) {
+            hash = (hash ^ bytes[b]) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+void logStep(InputLog* log, unsigned long step, const SimCommand* commands, int count, const ParticleStore* store)
+{
+    log->endStep = step;
+    bool check = step % INPUTLOG_CHECK_INTERVAL == 0;
+    int numEntries = check;
+    for (int c = 0; c < count; c++) {
+        numEntries += changesState(commands[c].type);
+    }
+    if (numEntries == 0) {
+        return;
+    }
+
+    unsigned char entry[2 * MAX_VARINT];
+    unsigned char* out = putVarint(entry, step - log->lastStep);
+    out = putVarint(out, numEntries);
+    fwrite(entry, 1, out - entry, log->file);
+    log->lastStep = step;
+    for (int c = 0; c < count; c++) {
+        if (changesState(commands[c].type)) {
+            writeEntry(log, &commands[c]);
+        }
+    }
+    if (check) {
+        uint64_t hash = hashPositions(store);
+        fputc(INPUTLOG_CHECKSUM, log->file);
+        fwrite(&hash, sizeof(hash), 1, log->file);
+    }
+}
+
+int replayStep(InputLog* log, unsigned long step, SimCommand* commands, int max)
+{
+    log->expected = 0;
+    if (log->finished || step > log->endStep) {
+        log->finished = true;
+        return -1;
+    }
+    if (step != log->nextStep) {
+        return 0;
+    }
+
+    int count;
+    bool isEnd;
+    log->cursor = readRecord(log, log->cursor, commands, max, &count, &isEnd);
+    if (log->cursor < log->data + log->size) {
+        uint64_t delta;
+        log->cursor = getVarint(log->cursor, &delta);
+        log->nextStep += delta;
+    } else {
+        log->nextStep = ULONG_MAX;
+    }
+    return count;
+}
+
+void checkReplay(InputLog* log, unsigned long step, const ParticleStore* store)
+{
+    if (log->expected == 0 || log->divergedAt != 0) {
+        return;
+    }
+    if (hashPositions(store) != log->expected) {
+        log->divergedAt = step;
+        printf("Replay diverged from the recording at step %lu\n", step);
+    }
+}
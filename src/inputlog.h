@@ -0,0 +1,67 @@
+#ifndef __INPUTLOG_H__
+#define __INPUTLOG_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "simulation.h"
+
+#define INPUTLOG_MAGIC 0x54504E49u // "INPT"
+#define INPUTLOG_VERSION 2
+#define INPUTLOG_CHECK_INTERVAL 60 // Steps between state checksums
+
+// File layout: an InputLogHeader, then one record per step that took any
+// commands or a checksum:
+//   varint (step - previous record's step), varint count,
+//   count x { uint8 type, fields of that type }
+// Fields are raw floats plus varints for handles and path lengths. Beside the
+// SimCommandTypes a record may hold INPUTLOG_CHECKSUM (uint64 hash of the
+// positions after the step) and, last in the file, INPUTLOG_END.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seed;     // Passed to srand before the run
+    uint32_t substeps;
+    double step;       // SIM_STEP of the recording run
+} InputLogHeader;
+
+// Everything that changes the simulation comes in through its command queue,
+// so logging each step's commands is enough to rerun a session step for step
+// from the same seed. Commands without an effect on the state (SIM_PICK,
+// SIM_SAVE) are left out.
+typedef struct InputLog {
+    FILE* file;            // Recording only
+    unsigned long lastStep;
+
+    // Replay: the whole log, read up front
+    unsigned char* data;
+    size_t size;
+    const unsigned char* cursor;
+    unsigned long nextStep; // Step of the record at the cursor
+    unsigned long endStep;  // Last step of the recording run
+    bool finished;
+    uint64_t expected;      // Checksum due after the step being replayed, 0 if none
+    unsigned long divergedAt; // First step whose checksum differed, 0 if none
+} InputLog;
+
+InputLog* createInputLog(const char* path, uint32_t seed);
+// For replay; NULL if the file can't be read or is not an input log
+InputLog* openInputLog(const char* path, uint32_t* seed);
+// Closing a recording writes its end marker
+void closeInputLog(InputLog* log);
+
+// FNV-1a over every particle position, stored in the log every
+// INPUTLOG_CHECK_INTERVAL steps to detect a replay going its own way
+uint64_t hashPositions(const ParticleStore* store);
+
+// Append the commands that step took
+void logStep(InputLog* log, unsigned long step, const SimCommand* commands, int count, const ParticleStore* store);
+
+// Fill commands with up to max commands recorded for step. Returns how many,
+// or -1 once the recording run's last step has been replayed.
+int replayStep(InputLog* log, unsigned long step, SimCommand* commands, int max);
+// Compare against the checksum recorded for step, if there is one
+void checkReplay(InputLog* log, unsigned long step, const ParticleStore* store);
+
+#endif
@@ -0,0 +1,184 @@
+#include "instances.h"
+#include "workers.h"
+#include "profiler.h"
+
+#include <stdlib.h>
+
+typedef struct {
+    const VerletObject* objects;
+    const mfloat_t* origins;
+    mfloat_t alpha;
+    int size;
+    const PackView* view;
+    InstanceData* dst;
+    unsigned char* keep; // 0 when filtered out, otherwise 1 + level; reused by the write pass
+    int chunkCounts[THREAD_COUNT][NUM_LODS];
+    int chunkCulled[THREAD_COUNT];
+    int chunkOccluded[THREAD_COUNT];
+    int chunkOffsets[THREAD_COUNT][NUM_LODS];
+} PackJob;
+
+static unsigned char* keepBuffer = NULL;
+static int keepCapacity = 0;
+
+void updatePackView(PackView* view, mfloat_t* projection, mfloat_t* viewMatrix, mfloat_t* eye, int screenHeight)
+{
+    mfloat_t m[MAT4_SIZE];
+    mat4_multiply(m, projection, viewMatrix);
+
+    // Gribb-Hartmann: each plane is the last row of the clip matrix plus or minus another row
+    for (int p = 0; p < 6; p++) {
+        int row = p / 2;
+        mfloat_t sign = (p % 2 == 0) ? 1.0f : -1.0f;
+        mfloat_t* plane = view->planes[p];
+        for (int c = 0; c < 4; c++) {
+            plane[c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+        }
+        mfloat_t length = vec3_length(plane);
+        for (int c = 0; c < 4; c++) {
+            plane[c] /= length;
+        }
+    }
+
+    vec3_assign(view->eye, eye);
+    view->pixelScale = projection[5] * screenHeight * 0.5f;
+}
+
+// Display position, alpha of the way from the step's origin to its end
+static void instancePosition(const PackJob* job, int i, mfloat_t* position)
+{
+    if (job->origins) {
+        vec3_lerp(position, (mfloat_t*)&job->origins[i * VEC3_SIZE], (mfloat_t*)job->objects[i].current, job->alpha);
+    } else {
+        vec3_assign(position, (mfloat_t*)job->objects[i].current);
+    }
+}
+
+static bool insideFrustum(const PackView* view, const mfloat_t* c, mfloat_t radius)
+{
+    for (int p = 0; p < 6; p++) {
+        const mfloat_t* plane = view->planes[p];
+        if (plane[0] * c[0] + plane[1] * c[1] + plane[2] * c[2] + plane[3] < -radius) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int selectLevel(const PackView* view, mfloat_t* position, mfloat_t radius)
+{
+    mfloat_t dist = vec3_distance(position, (mfloat_t*)view->eye);
+    mfloat_t pixels = radius * view->pixelScale / MFMAX(dist, MFLOAT_C(1e-3));
+    int level = 0;
+    while (level < NUM_LODS - 1 && pixels >= view->lodPixels[level]) {
+        level++;
+    }
+    return level;
+}
+
+static void filterChunk(int worker, void* arg)
+{
+    PackJob* job = arg;
+    int start, end;
+    workerRange(worker, job->size, &start, &end);
+
+    int* counts = job->chunkCounts[worker];
+    for (int l = 0; l < NUM_LODS; l++) {
+        counts[l] = 0;
+    }
+    int culled = 0, occluded = 0;
+    bool occlusion = job->view->occlusionCull && job->view->occlusion;
+    PROFILE_BEGIN(PROFILE_WORKERS + worker, PROFILE_PACK);
+    for (int i = start; i < end; i++) {
+        const VerletObject* obj = &job->objects[i];
+        mfloat_t position[VEC3_SIZE];
+        instancePosition(job, i, position);
+        if (job->view->frustumCull && !insideFrustum(job->view, position, obj->radius)) {
+            job->keep[i] = 0;
+            culled++;
+            continue;
+        }
+        if (occlusion && isSphereOccluded(job->view->occlusion, job->view->eye, position, obj->radius)) {
+            job->keep[i] = 0;
+            occluded++;
+            continue;
+        }
+        int level = selectLevel(job->view, position, obj->radius);
+        job->keep[i] = 1 + level;
+        counts[level]++;
+    }
+    job->chunkCulled[worker] = culled;
+    job->chunkOccluded[worker] = occluded;
+    PROFILE_END(PROFILE_WORKERS + worker, PROFILE_PACK);
+}
+
+static void writeChunk(int worker, void* arg)
+{
+    PackJob* job = arg;
+    int start, end;
+    workerRange(worker, job->size, &start, &end);
+
+    InstanceData* cursors[NUM_LODS];
+    for (int l = 0; l < NUM_LODS; l++) {
+        cursors[l] = job->dst + job->chunkOffsets[worker][l];
+    }
+    PROFILE_BEGIN(PROFILE_WORKERS + worker, PROFILE_PACK);
+    for (int i = start; i < end; i++) {
+        if (!job->keep[i]) {
+            continue;
+        }
+        const VerletObject* obj = &job->objects[i];
+        InstanceData* instance = cursors[job->keep[i] - 1]++;
+        mfloat_t position[VEC3_SIZE];
+        instancePosition(job, i, position);
+        instance->position[0] = position[0];
+        instance->position[1] = position[1];
+        instance->position[2] = position[2];
+        instance->velocity = vec3_distance((mfloat_t*)obj->current, (mfloat_t*)obj->previous) * 10;
+        instance->color[0] = obj->colorVector[0];
+        instance->color[1] = obj->colorVector[1];
+        instance->color[2] = obj->colorVector[2];
+        instance->radius = obj->radius;
+    }
+    PROFILE_END(PROFILE_WORKERS + worker, PROFILE_PACK);
+}
+
+void packInstances(const VerletObject* objects, const mfloat_t* origins, mfloat_t alpha, int size,
+    const PackView* view, InstanceData* dst, PackResult* result)
+{
+    if (size > keepCapacity) {
+        keepCapacity = size;
+        keepBuffer = realloc(keepBuffer, keepCapacity);
+    }
+
+    PackJob job;
+    job.objects = objects;
+    job.origins = origins;
+    job.alpha = alpha;
+    job.size = size;
+    job.view = view;
+    job.dst = dst;
+    job.keep = keepBuffer;
+
+    runWorkers(filterChunk, &job);
+
+    // Exclusive prefix sum, level-major so each level's bucket is contiguous
+    int total = 0;
+    for (int l = 0; l < NUM_LODS; l++) {
+        result->lodOffset[l] = total;
+        for (int w = 0; w < THREAD_COUNT; w++) {
+            job.chunkOffsets[w][l] = total;
+            total += job.chunkCounts[w][l];
+        }
+        result->lodCount[l] = total - result->lodOffset[l];
+    }
+    result->total = total;
+    result->frustumCulled = 0;
+    result->occlusionCulled = 0;
+    for (int w = 0; w < THREAD_COUNT; w++) {
+        result->frustumCulled += job.chunkCulled[w];
+        result->occlusionCulled += job.chunkOccluded[w];
+    }
+
+    runWorkers(writeChunk, &job);
+}
@@ -0,0 +1,46 @@
+#ifndef __INSTANCES_H__
+#define __INSTANCES_H__
+
+#include "model.h"
+#include "occlusion.h"
+#include "verlet.h"
+
+// Icosphere levels 0-3, 20 to 1280 triangles; the finest stays near the 960 of
+// models/sphere.obj, which particles were drawn with before
+#define NUM_LODS 4
+
+// Camera state needed to cull instances and pick a level of detail per instance
+typedef struct {
+    mfloat_t eye[VEC3_SIZE];
+    mfloat_t planes[6][4];         // Frustum planes (normal, distance), pointing inwards
+    bool frustumCull;
+    mfloat_t pixelScale;           // Projected pixels per unit radius at unit distance
+    float lodPixels[NUM_LODS - 1]; // Projected radius (px) at which level l + 1 takes over
+    const DepthPyramid* occlusion; // Depth of an earlier frame, NULL to skip
+    bool occlusionCull;
+} PackView;
+
+// Instances are grouped by level: level l occupies [lodOffset[l], lodOffset[l] + lodCount[l])
+typedef struct {
+    int total;
+    int frustumCulled;
+    int occlusionCulled;
+    int lodCount[NUM_LODS];
+    int lodOffset[NUM_LODS];
+} PackResult;
+
+// Refresh eye, frustum planes and pixel scale from the current camera matrices
+void updatePackView(PackView* view, mfloat_t* projection, mfloat_t* viewMatrix, mfloat_t* eye, int screenHeight);
+
+// Pack the visible particles of objects[0, size) into dst on the worker pool.
+// Each worker drops particles outside the view frustum or hidden behind the
+// depth of an earlier frame from its chunk and picks
+// a level from the projected radius, a prefix sum over the per-chunk level
+// counts gives every worker its output offset in each level bucket, and the
+// workers then write their compacted chunk straight into dst.
+// With origins (VEC3_SIZE per object) positions are interpolated alpha of the
+// way from origins to current; pass NULL to use current as is.
+void packInstances(const VerletObject* objects, const mfloat_t* origins, mfloat_t alpha, int size,
+    const PackView* view, InstanceData* dst, PackResult* result);
+
+#endif
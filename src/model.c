@@ -1,15 +1,24 @@
 #include "model.h"
+#include "objloader.h"
 #include "util.h"
+#include "uthash.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "GL/glew.h"
 
-#define VERTEX_LIMIT 2000
+#define VERTEX_CACHE_SIZE 16 // Post-transform cache size assumed by the index optimizer
 
-DynamicArray* loadOBJ(const char* filename);
-void processVertex(DynamicArray* vertices, char* vertexData[3], Vertex v[], Vertex vt[], Vertex vn[]);
+// Midpoint of an icosphere edge, keyed by its two vertex indices
+typedef struct {
+    unsigned long long edge;
+    unsigned int index;
+    UT_hash_handle hh;
+} MidpointEntry;
+
+void optimizeMesh(Mesh* mesh);
+void uploadMesh(Mesh* mesh, bool instanced);
 
 Model* createModel(Mesh* mesh)
 {
@@ -30,12 +39,24 @@ void destroyModel(Model* model)
 
 Mesh* createMesh(const char* filename, bool instanced)
 {
-    DynamicArray* dArray = loadOBJ(filename);
-
     Mesh* mesh = malloc(sizeof(Mesh));
-    mesh->vertices = dArray->array;
-    mesh->numVertices = dArray->size / STRIDE;
+    // A cached copy of the optimized mesh skips parsing and optimizing
+    uint64_t hash = hashMeshFile(filename);
+    if (hash == 0 || !loadMeshCache(hash, mesh)) {
+        if (!loadOBJ(filename, mesh)) {
+            exit(EXIT_FAILURE);
+        }
+        optimizeMesh(mesh);
+        if (hash != 0) {
+            saveMeshCache(hash, mesh);
+        }
+    }
+    uploadMesh(mesh, instanced);
+    return mesh;
+}
 
+void uploadMesh(Mesh* mesh, bool instanced)
+{
     // Create our Vertex Buffer and Vertex Array Objects
     glGenVertexArrays(1, &(mesh->VAO));
     glBindVertexArray(mesh->VAO);
@@ -56,30 +77,20 @@ Mesh* createMesh(const char* filename, bool instanced)
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, STRIDE * sizeof(float), (void*)24);
 
+    // The element buffer binding is recorded in the VAO
+    mesh->EBO = 0;
+    if (mesh->numIndices > 0) {
+        glGenBuffers(1, &(mesh->EBO));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * mesh->numIndices, mesh->indices, GL_STATIC_DRAW);
+    }
+
     if (instanced) {
-        // Position
-        glGenBuffers(1, &(mesh->positionVBO));
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->positionVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * INSTANCE_STRIDE * MAX_INSTANCES, NULL, GL_STREAM_DRAW);
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, INSTANCE_STRIDE * sizeof(float), (void*)0);
-        glVertexAttribDivisor(3, 1);
-
-        // Velocity
-        glGenBuffers(1, &(mesh->velocityVBO));
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->velocityVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * MAX_INSTANCES, NULL, GL_STREAM_DRAW);
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, sizeof(float), (void*)0);
-        glVertexAttribDivisor(4, 1);
-
-            // Color
-        glGenBuffers(1, &(mesh->colorVBO));
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->colorVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(float) * VEC3_SIZE * MAX_INSTANCES, NULL, GL_STREAM_DRAW);
-        glEnableVertexAttribArray(5);
-        glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, VEC3_SIZE * sizeof(float), (void*)0);
-        glVertexAttribDivisor(5, 1);
+        // Instance attributes are pointed at the current stream region by bindInstanceStream
+        for (int attrib = 3; attrib <= 6; attrib++) {
+            glEnableVertexAttribArray(attrib);
+            glVertexAttribDivisor(attrib, 1);
+        }
     }
 
     // note that this is allowed, the call to glVertexAttribPointer registered VBO as the vertex attribute's bound vertex buffer object so afterwards we can safely unbind
@@ -91,103 +102,254 @@ Mesh* createMesh(const char* filename, bool instanced)
 
     // uncomment this call to draw in wireframe polygons.
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+}
 
+Mesh* createImpostorMesh()
+{
+    // Unit quad drawn as a triangle strip; the impostor shader scales it to each sphere
+    float corners[4][STRIDE] = {
+        { -1, -1, 0, 0, 0, 1, 0, 0 },
+        { 1, -1, 0, 0, 0, 1, 1, 0 },
+        { -1, 1, 0, 0, 0, 1, 0, 1 },
+        { 1, 1, 0, 0, 0, 1, 1, 1 },
+    };
+
+    Mesh* mesh = malloc(sizeof(Mesh));
+    mesh->numVertices = 4;
+    mesh->vertices = malloc(sizeof(corners));
+    memcpy(mesh->vertices, corners, sizeof(corners));
+    mesh->numIndices = 0;
+    mesh->indices = NULL;
+    uploadMesh(mesh, true);
     return mesh;
 }
 
-DynamicArray* loadOBJ(const char* filename)
+static unsigned int pushSphereVertex(DynamicArray* vertices, mfloat_t* p)
 {
-    Vertex v[VERTEX_LIMIT];
-    Vertex vt[VERTEX_LIMIT];
-    Vertex vn[VERTEX_LIMIT];
+    mfloat_t n[VEC3_SIZE];
+    vec3_normalize(n, p);
+    push(vertices, n[0]);
+    push(vertices, n[1]);
+    push(vertices, n[2]);
+    // Unit sphere: the normal is the position
+    push(vertices, n[0]);
+    push(vertices, n[1]);
+    push(vertices, n[2]);
+    push(vertices, 0.5f + MATAN2(n[2], n[0]) / (2.0f * MPI));
+    push(vertices, 0.5f - MASIN(n[1]) / MPI);
+    return vertices->size / STRIDE - 1;
+}
 
-    int v_count = 0;
-    int vt_count = 0;
-    int vn_count = 0;
+static unsigned int midpoint(DynamicArray* vertices, MidpointEntry** cache, unsigned int a, unsigned int b)
+{
+    unsigned long long edge = a < b ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+    MidpointEntry* entry;
+    HASH_FIND(hh, *cache, &edge, sizeof(edge), entry);
+    if (entry) {
+        return entry->index;
+    }
 
-    DynamicArray* vertices = malloc(sizeof(DynamicArray));
-    initialize(vertices, 160);
+    mfloat_t mid[VEC3_SIZE];
+    vec3_add(mid, &vertices->array[a * STRIDE], &vertices->array[b * STRIDE]);
+    entry = malloc(sizeof(MidpointEntry));
+    entry->edge = edge;
+    entry->index = pushSphereVertex(vertices, mid);
+    HASH_ADD(hh, *cache, edge, sizeof(edge), entry);
+    return entry->index;
+}
 
-    FILE* fp = fopen(filename, "r");
-    if (fp == NULL) {
-        printf("Error opening file: %s\n", filename);
-        exit(EXIT_FAILURE);
+Mesh* createIcosphereMesh(int level, bool instanced)
+{
+    const mfloat_t t = (1.0f + MSQRT(5.0f)) / 2.0f;
+    mfloat_t corners[12][VEC3_SIZE] = {
+        { -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+        { 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+        { t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 },
+    };
+    unsigned int faces[20 * 3] = {
+        0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+        1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+        4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1,
+    };
+
+    DynamicArray vertices;
+    initialize(&vertices, 12 * STRIDE);
+    for (int i = 0; i < 12; i++) {
+        pushSphereVertex(&vertices, corners[i]);
     }
 
-    char* line = NULL;
-    size_t len = 0;
-    size_t read;
-
-    while ((read = getline(&line, &len, fp)) != -1) {
-        char* words[4];
-        words[0] = strtok(line, " ");
-        for (int i = 1; i < 4; ++i) {
-            words[i] = strtok(NULL, " ");
+    int numIndices = 20 * 3;
+    unsigned int* indices = malloc(sizeof(faces));
+    memcpy(indices, faces, sizeof(faces));
+
+    // Split every triangle into four, projecting the new midpoints onto the sphere
+    for (int l = 0; l < level; l++) {
+        MidpointEntry* cache = NULL;
+        unsigned int* refined = malloc(sizeof(unsigned int) * numIndices * 4);
+        for (int i = 0; i < numIndices; i += 3) {
+            unsigned int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+            unsigned int ab = midpoint(&vertices, &cache, a, b);
+            unsigned int bc = midpoint(&vertices, &cache, b, c);
+            unsigned int ca = midpoint(&vertices, &cache, c, a);
+            unsigned int tris[12] = { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca };
+            memcpy(&refined[i * 4], tris, sizeof(tris));
         }
-
-        if (strcmp(words[0], "v") == 0) {
-            v[v_count].x = atof(words[1]);
-            v[v_count].y = atof(words[2]);
-            v[v_count].z = atof(words[3]);
-            v_count++;
-        } else if (strcmp(words[0], "vt") == 0) {
-            vt[vt_count].x = atof(words[1]);
-            vt[vt_count].y = atof(words[2]);
-            vt_count++;
-        } else if (strcmp(words[0], "vn") == 0) {
-            vn[vn_count].x = atof(words[1]);
-            vn[vn_count].y = atof(words[2]);
-            vn[vn_count].z = atof(words[3]);
-            vn_count++;
-        } else if (strcmp(words[0], "f") == 0) {
-            char* v1[3];
-            char* v2[3];
-            char* v3[3];
-
-            v1[0] = strtok(words[1], "/");
-            v1[1] = strtok(NULL, "/");
-            v1[2] = strtok(NULL, "/");
-            v2[0] = strtok(words[2], "/");
-            v2[1] = strtok(NULL, "/");
-            v2[2] = strtok(NULL, "/");
-            v3[0] = strtok(words[3], "/");
-            v3[1] = strtok(NULL, "/");
-            v3[2] = strtok(NULL, "/");
-
-            processVertex(vertices, v1, v, vt, vn);
-            processVertex(vertices, v2, v, vt, vn);
-            processVertex(vertices, v3, v, vt, vn);
+        MidpointEntry* entry;
+        MidpointEntry* tmp;
+        HASH_ITER(hh, cache, entry, tmp)
+        {
+            HASH_DEL(cache, entry);
+            free(entry);
         }
-    }
-    fclose(fp);
-    if (line) {
-        free(line);
+        free(indices);
+        indices = refined;
+        numIndices *= 4;
     }
 
-    return vertices;
+    Mesh* mesh = malloc(sizeof(Mesh));
+    mesh->vertices = vertices.array;
+    mesh->numVertices = vertices.size / STRIDE;
+    mesh->indices = indices;
+    mesh->numIndices = numIndices;
+    optimizeMesh(mesh);
+    uploadMesh(mesh, instanced);
+    return mesh;
 }
 
-void processVertex(DynamicArray* vertices, char* vertexData[3], Vertex v[], Vertex vt[], Vertex vn[])
+// Tipsify (Sander et al. 2007): fans around recently used vertices so most
+// index fetches hit the post-transform cache, then renumbers the vertices in
+// first-use order so vertex fetches walk memory linearly.
+void optimizeMesh(Mesh* mesh)
 {
-    int vertex_ptr = atoi(vertexData[0]) - 1;
-    int texture_ptr = atoi(vertexData[1]) - 1;
-    int normal_ptr = atoi(vertexData[2]) - 1;
+    int numVertices = mesh->numVertices;
+    int numTriangles = mesh->numIndices / 3;
+    unsigned int* indices = mesh->indices;
+    if (numVertices == 0 || numTriangles == 0) {
+        return; // Nothing to reorder
+    }
 
-    push(vertices, v[vertex_ptr].x);
-    push(vertices, v[vertex_ptr].y);
-    push(vertices, v[vertex_ptr].z);
+    // Vertex -> triangle adjacency in CSR form
+    int* offsets = calloc(numVertices + 1, sizeof(int));
+    int* live = calloc(numVertices, sizeof(int));
+    for (int i = 0; i < numTriangles * 3; i++) {
+        live[indices[i]]++;
+    }
+    for (int v = 0; v < numVertices; v++) {
+        offsets[v + 1] = offsets[v] + live[v];
+    }
+    int* fill = malloc(sizeof(int) * numVertices);
+    memcpy(fill, offsets, sizeof(int) * numVertices);
+    int* adjacency = malloc(sizeof(int) * numTriangles * 3);
+    for (int i = 0; i < numTriangles * 3; i++) {
+        adjacency[fill[indices[i]]++] = i / 3;
+    }
 
-    push(vertices, vn[normal_ptr].x);
-    push(vertices, vn[normal_ptr].y);
-    push(vertices, vn[normal_ptr].z);
+    int* stamps = calloc(numVertices, sizeof(int));
+    bool* emitted = calloc(numTriangles, sizeof(bool));
+    int* deadEnd = malloc(sizeof(int) * numTriangles * 3);
+    int deadEndSize = 0;
+    int* candidates = malloc(sizeof(int) * numTriangles * 3);
+    unsigned int* output = malloc(sizeof(unsigned int) * numTriangles * 3);
+    int numOutput = 0;
+
+    int fanning = 0;
+    int time = VERTEX_CACHE_SIZE + 1;
+    int cursor = 0;
+    while (fanning >= 0) {
+        int numCandidates = 0;
+        for (int a = offsets[fanning]; a < offsets[fanning + 1]; a++) {
+            int t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            for (int k = 0; k < 3; k++) {
+                int v = indices[t * 3 + k];
+                output[numOutput++] = v;
+                deadEnd[deadEndSize++] = v;
+                candidates[numCandidates++] = v;
+                live[v]--;
+                if (time - stamps[v] > VERTEX_CACHE_SIZE) {
+                    stamps[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
 
-    push(vertices, vt[texture_ptr].x);
-    push(vertices, vt[texture_ptr].y);
+        // Prefer the candidate that will still be in the cache after its fan
+        int next = -1;
+        int best = -1;
+        for (int c = 0; c < numCandidates; c++) {
+            int v = candidates[c];
+            if (live[v] <= 0) {
+                continue;
+            }
+            int priority = 0;
+            if (time - stamps[v] + 2 * live[v] <= VERTEX_CACHE_SIZE) {
+                priority = time - stamps[v];
+            }
+            if (priority > best) {
+                best = priority;
+                next = v;
+            }
+        }
+        // Dead end: back up through recently emitted vertices, then scan forward
+        while (next == -1 && deadEndSize > 0) {
+            int v = deadEnd[--deadEndSize];
+            if (live[v] > 0) {
+                next = v;
+            }
+        }
+        while (next == -1 && cursor < numVertices) {
+            if (live[cursor] > 0) {
+                next = cursor;
+            }
+            cursor++;
+        }
+        fanning = next;
+    }
+
+    // Renumber vertices in order of first use
+    int* remap = malloc(sizeof(int) * numVertices);
+    memset(remap, -1, sizeof(int) * numVertices);
+    float* vertices = malloc(sizeof(float) * STRIDE * numVertices);
+    int numRemapped = 0;
+    for (int i = 0; i < numOutput; i++) {
+        int v = output[i];
+        if (remap[v] < 0) {
+            remap[v] = numRemapped;
+            memcpy(&vertices[numRemapped * STRIDE], &mesh->vertices[v * STRIDE], sizeof(float) * STRIDE);
+            numRemapped++;
+        }
+        output[i] = remap[v];
+    }
+
+    free(mesh->vertices);
+    free(mesh->indices);
+    mesh->vertices = vertices;
+    mesh->numVertices = numRemapped;
+    mesh->indices = output;
+    mesh->numIndices = numOutput;
+
+    free(offsets);
+    free(live);
+    free(fill);
+    free(adjacency);
+    free(stamps);
+    free(emitted);
+    free(deadEnd);
+    free(candidates);
+    free(remap);
 }
 
 void destroyMesh(Mesh* mesh)
 {
     glDeleteVertexArrays(1, &(mesh->VAO));
     glDeleteBuffers(1, &(mesh->VBO));
+    if (mesh->EBO) {
+        glDeleteBuffers(1, &(mesh->EBO));
+    }
+    free(mesh->vertices);
+    free(mesh->indices);
     free(mesh);
 }
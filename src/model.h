@@ -2,7 +2,6 @@
 #define __MODEL_H__
 
 #define STRIDE 8
-#define INSTANCE_STRIDE 3
 #define MAX_INSTANCES 20000
 
 #include "mathc.h"
@@ -10,13 +9,21 @@
 typedef struct {
     int numVertices;
     float* vertices;
+    int numIndices;        // 0 for non-indexed meshes
+    unsigned int* indices;
     unsigned int VAO;
     unsigned int VBO;
-    unsigned int positionVBO;
-    unsigned int velocityVBO;
-    unsigned int colorVBO;
+    unsigned int EBO;
 } Mesh;
 
+// Interleaved per-instance record streamed to attributes 3-6 (see stream.h)
+typedef struct {
+    float position[VEC3_SIZE];
+    float velocity;
+    float color[VEC3_SIZE];
+    float radius;
+} InstanceData;
+
 typedef struct {
     Mesh* mesh;
     mfloat_t position[VEC3_SIZE];
@@ -25,16 +32,18 @@ typedef struct {
     unsigned int renderMethod;
 } Model;
 
-typedef struct {
-    float x, y, z;
-} Vertex;
-
 Model* createModel(Mesh* mesh);
 
 void destroyModel(Model* model);
 
 Mesh* createMesh(const char* filename, bool instanced);
 
+// Unit icosphere subdivided level times (20 * 4^level triangles)
+Mesh* createIcosphereMesh(int level, bool instanced);
+
+// Camera-facing quad for ray-cast sphere impostors (GL_TRIANGLE_STRIP)
+Mesh* createImpostorMesh();
+
 void destroyMesh(Mesh* mesh);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,485 @@
+#define _POSIX_C_SOURCE 200809L // mmap, mkdir
+
+#include "objloader.h"
+#include "workers.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MISSING -1 // Corner without a texture coordinate or normal
+
+typedef struct {
+    const char* begin;
+    const char* end;
+    // Pass one counts, then the prefix sums place the chunk in the shared arrays
+    int numPositions, numTexcoords, numNormals, numTriangles;
+    int firstPosition, firstTexcoord, firstNormal, firstTriangle;
+} ObjChunk;
+
+typedef struct {
+    ObjChunk chunks[THREAD_COUNT];
+    float* positions; // 3 per v
+    float* texcoords; // 2 per vt
+    float* normals;   // 3 per vn
+    int* corners;     // 9 per triangle: position, texcoord, normal of each corner
+    int totalPositions, totalTexcoords, totalNormals;
+} ObjParse;
+
+static bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* skipBlanks(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p)) {
+        p++;
+    }
+    return p;
+}
+
+static const char* lineEnd(const char* p, const char* end)
+{
+    const char* newline = memchr(p, '\n', end - p);
+    return newline ? newline : end;
+}
+
+// strtof without the locale, errno and the copy into a terminated string
+static const char* scanFloat(const char* p, const char* end, float* value)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    p = skipBlanks(p, end);
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    double mantissa = 0.0;
+    int exponent = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        mantissa = mantissa * 10.0 + (*p - '0');
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            mantissa = mantissa * 10.0 + (*p - '0');
+            exponent--;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) {
+            p++;
+        }
+        int e = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            e = e < 10000 ? e * 10 + (*p - '0') : e;
+        }
+        exponent += negativeExponent ? -e : e;
+    }
+    // Dividing by an exact power of ten rounds better than multiplying by an inexact one
+    if (exponent < 0) {
+        mantissa = -exponent <= 22 ? mantissa / powers[-exponent] : mantissa * pow(10.0, exponent);
+    } else if (exponent > 0) {
+        mantissa = exponent <= 22 ? mantissa * powers[exponent] : mantissa * pow(10.0, exponent);
+    }
+    *value = (float)(negative ? -mantissa : mantissa);
+    return p;
+}
+
+static const char* scanInt(const char* p, const char* end, int* value, bool* found)
+{
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+        p++;
+    }
+    long result = 0;
+    *found = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        result = result < 0x7FFFFFFF ? result * 10 + (*p - '0') : result;
+        *found = true;
+    }
+    *value = (int)(negative ? -result : result);
+    return p;
+}
+
+// 1-based, or negative counting back from the last one defined so far
+static int resolveIndex(int index, bool found, int defined, int total)
+{
+    if (!found || index == 0) {
+        return MISSING;
+    }
+    int resolved = index > 0 ? index - 1 : defined + index;
+    return resolved >= 0 && resolved < total ? resolved : MISSING;
+}
+
+// Pass one: how many of each element the chunk defines
+static void countChunk(int worker, void* arg)
+{
+    ObjParse* parse = arg;
+    ObjChunk* chunk = &parse->chunks[worker];
+    const char* end = chunk->end;
+    for (const char* p = chunk->begin; p < end; p++) {
+        const char* eol = lineEnd(p, end);
+        p = skipBlanks(p, eol);
+        if (eol - p >= 2 && p[0] == 'v' && isBlank(p[1])) {
+            chunk->numPositions++;
+        } else if (eol - p >= 3 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+            chunk->numTexcoords++;
+        } else if (eol - p >= 3 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+            chunk->numNormals++;
+        } else if (eol - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+            int corners = 0;
+            for (const char* q = skipBlanks(p + 1, eol); q < eol; q = skipBlanks(q, eol)) {
+                corners++;
+                while (q < eol && !isBlank(*q)) {
+                    q++;
+                }
+            }
+            chunk->numTriangles += corners > 2 ? corners - 2 : 0;
+        }
+        p = eol;
+    }
+}
+
+// Pass two: fill the chunk's share of the arrays
+static void parseChunk(int worker, void* arg)
+{
+    ObjParse* parse = arg;
+    ObjChunk* chunk = &parse->chunks[worker];
+    float* position = &parse->positions[chunk->firstPosition * 3];
+    float* texcoord = &parse->texcoords[chunk->firstTexcoord * 2];
+    float* normal = &parse->normals[chunk->firstNormal * 3];
+    int* corners = &parse->corners[chunk->firstTriangle * 9];
+    int positions = chunk->firstPosition, texcoords = chunk->firstTexcoord, normals = chunk->firstNormal;
+
+    const char* end = chunk->end;
+    for (const char* p = chunk->begin; p < end; p++) {
+        const char* eol = lineEnd(p, end);
+        p = skipBlanks(p, eol);
+        if (eol - p >= 2 && p[0] == 'v' && isBlank(p[1])) {
+            p = scanFloat(p + 1, eol, position++);
+            p = scanFloat(p, eol, position++);
+            scanFloat(p, eol, position++);
+            positions++;
+        } else if (eol - p >= 3 && p[0] == 'v' && p[1] == 't' && isBlank(p[2])) {
+            p = scanFloat(p + 2, eol, texcoord++);
+            scanFloat(p, eol, texcoord++);
+            texcoords++;
+        } else if (eol - p >= 3 && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+            p = scanFloat(p + 2, eol, normal++);
+            p = scanFloat(p, eol, normal++);
+            scanFloat(p, eol, normal++);
+            normals++;
+        } else if (eol - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+            // Fan around the first corner: (0, 1, 2), (0, 2, 3), ...
+            int first[3], previous[3];
+            int numCorners = 0;
+            for (const char* q = skipBlanks(p + 1, eol); q < eol; q = skipBlanks(q, eol)) {
+                int index[3] = { 0, 0, 0 };
+                bool found[3] = { false, false, false };
+                q = scanInt(q, eol, &index[0], &found[0]);
+                for (int k = 1; k < 3 && q < eol && *q == '/'; k++) {
+                    q = scanInt(q + 1, eol, &index[k], &found[k]);
+                }
+                while (q < eol && !isBlank(*q)) {
+                    q++;
+                }
+                int corner[3] = {
+                    resolveIndex(index[0], found[0], positions, parse->totalPositions),
+                    resolveIndex(index[1], found[1], texcoords, parse->totalTexcoords),
+                    resolveIndex(index[2], found[2], normals, parse->totalNormals),
+                };
+                if (numCorners == 0) {
+                    memcpy(first, corner, sizeof(first));
+                } else if (numCorners >= 2) {
+                    memcpy(corners, first, sizeof(first));
+                    memcpy(corners + 3, previous, sizeof(previous));
+                    memcpy(corners + 6, corner, sizeof(corner));
+                    corners += 9;
+                }
+                memcpy(previous, corner, sizeof(previous));
+                numCorners++;
+            }
+        }
+        p = eol;
+    }
+}
+
+static uint32_t hashCorner(const int* key)
+{
+    uint64_t h = (uint64_t)(uint32_t)key[0] * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)(uint32_t)key[1] * 0xC2B2AE3D27D4EB4FULL;
+    h ^= (uint64_t)(uint32_t)key[2] * 0x165667B19E3779F9ULL;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static void buildMesh(const ObjParse* parse, int numTriangles, Mesh* mesh)
+{
+    int numCorners = numTriangles * 3;
+    size_t tableSize = 16;
+    while (tableSize < (size_t)numCorners * 2) {
+        tableSize *= 2;
+    }
+    // Vertex + 1 for each distinct v/vt/vn, open addressed; 0 is empty
+    unsigned int* table = calloc(tableSize, sizeof(unsigned int));
+    int* keys = malloc(sizeof(int) * 3 * (numCorners > 0 ? numCorners : 1));
+
+    float* vertices = malloc(sizeof(float) * STRIDE * (numCorners > 0 ? numCorners : 1));
+    unsigned int* indices = malloc(sizeof(unsigned int) * (numCorners > 0 ? numCorners : 1));
+    bool* smooth = malloc(sizeof(bool) * (numCorners > 0 ? numCorners : 1)); // Vertex had no normal
+    int numVertices = 0, numIndices = 0, dropped = 0;
+    bool smoothNormals = false;
+    for (int t = 0; t < numTriangles; t++) {
+        const int* triangle = &parse->corners[t * 9];
+        if (triangle[0] == MISSING || triangle[3] == MISSING || triangle[6] == MISSING) {
+            dropped++;
+            continue;
+        }
+        for (int c = 0; c < 3; c++) {
+            const int* key = &triangle[c * 3];
+            size_t s = hashCorner(key) & (tableSize - 1);
+            while (table[s] != 0) {
+                const int* other = &keys[(table[s] - 1) * 3];
+                if (other[0] == key[0] && other[1] == key[1] && other[2] == key[2]) {
+                    break;
+                }
+                s = (s + 1) & (tableSize - 1);
+            }
+            if (table[s] == 0) {
+                memcpy(&keys[numVertices * 3], key, sizeof(int) * 3);
+                table[s] = numVertices + 1;
+                smooth[numVertices] = key[2] == MISSING;
+                float* vertex = &vertices[numVertices++ * STRIDE];
+                memcpy(vertex, &parse->positions[key[0] * 3], sizeof(float) * 3);
+                if (key[2] != MISSING) {
+                    memcpy(vertex + 3, &parse->normals[key[2] * 3], sizeof(float) * 3);
+                } else {
+                    vertex[3] = vertex[4] = vertex[5] = 0.0f;
+                    smoothNormals = true;
+                }
+                if (key[1] != MISSING) {
+                    memcpy(vertex + 6, &parse->texcoords[key[1] * 2], sizeof(float) * 2);
+                } else {
+                    vertex[6] = vertex[7] = 0.0f;
+                }
+            }
+            indices[numIndices++] = table[s] - 1;
+        }
+    }
+    free(table);
+    free(keys);
+
+    if (smoothNormals) {
+        // Area weighted face normals summed into the vertices that had none
+        for (int i = 0; i < numIndices; i += 3) {
+            float* a = &vertices[indices[i] * STRIDE];
+            float* b = &vertices[indices[i + 1] * STRIDE];
+            float* c = &vertices[indices[i + 2] * STRIDE];
+            mfloat_t ab[VEC3_SIZE], ac[VEC3_SIZE], n[VEC3_SIZE];
+            vec3_subtract(ab, b, a);
+            vec3_subtract(ac, c, a);
+            vec3_cross(n, ab, ac);
+            for (int k = 0; k < 3; k++) {
+                if (smooth[indices[i + k]]) {
+                    float* vertex = &vertices[indices[i + k] * STRIDE];
+                    vec3_add(vertex + 3, vertex + 3, n);
+                }
+            }
+        }
+        for (int v = 0; v < numVertices; v++) {
+            float* normal = &vertices[v * STRIDE + 3];
+            if (smooth[v] && vec3_length(normal) > 0.0f) {
+                vec3_normalize(normal, normal);
+            }
+        }
+    }
+    free(smooth);
+    if (dropped > 0) {
+        printf("Dropped %d triangles without a valid position\n", dropped);
+    }
+
+    mesh->vertices = realloc(vertices, sizeof(float) * STRIDE * (numVertices > 0 ? numVertices : 1));
+    mesh->numVertices = numVertices;
+    mesh->indices = indices;
+    mesh->numIndices = numIndices;
+}
+
+bool loadOBJ(const char* filename, Mesh* mesh)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        printf("Error opening file: %s\n", filename);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    size_t size = info.st_size;
+    const char* data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Failed to map %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+
+    // Chunks split at line boundaries
+    ObjParse parse;
+    memset(&parse, 0, sizeof(parse));
+    const char* cursor = data;
+    for (int w = 0; w < THREAD_COUNT; w++) {
+        ObjChunk* chunk = &parse.chunks[w];
+        chunk->begin = cursor;
+        const char* split = data + (size_t)((double)size * (w + 1) / THREAD_COUNT);
+        if (split < cursor) {
+            split = cursor;
+        }
+        const char* newline = split < data + size ? memchr(split, '\n', data + size - split) : NULL;
+        cursor = w == THREAD_COUNT - 1 || newline == NULL ? data + size : newline + 1;
+        chunk->end = cursor;
+    }
+
+    runWorkers(countChunk, &parse);
+    int numTriangles = 0;
+    for (int w = 0; w < THREAD_COUNT; w++) {
+        ObjChunk* chunk = &parse.chunks[w];
+        chunk->firstPosition = parse.totalPositions;
+        chunk->firstTexcoord = parse.totalTexcoords;
+        chunk->firstNormal = parse.totalNormals;
+        chunk->firstTriangle = numTriangles;
+        parse.totalPositions += chunk->numPositions;
+        parse.totalTexcoords += chunk->numTexcoords;
+        parse.totalNormals += chunk->numNormals;
+        numTriangles += chunk->numTriangles;
+    }
+    parse.positions = malloc(sizeof(float) * 3 * (parse.totalPositions + 1));
+    parse.texcoords = malloc(sizeof(float) * 2 * (parse.totalTexcoords + 1));
+    parse.normals = malloc(sizeof(float) * 3 * (parse.totalNormals + 1));
+    parse.corners = malloc(sizeof(int) * 9 * (numTriangles + 1));
+    runWorkers(parseChunk, &parse);
+    if (data) {
+        munmap((void*)data, size);
+    }
+
+    buildMesh(&parse, numTriangles, mesh);
+    free(parse.positions);
+    free(parse.texcoords);
+    free(parse.normals);
+    free(parse.corners);
+    return true;
+}
+
+uint64_t hashMeshFile(const char* filename)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    size_t size = info.st_size;
+    const unsigned char* data = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+
+    // FNV-1a a word at a time, seeded with the layout the cache depends on
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t layout[3] = { MESH_CACHE_VERSION, STRIDE, size };
+    for (int i = 0; i < 3; i++) {
+        hash = (hash ^ layout[i]) * 0x100000001b3ULL;
+    }
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    if (data) {
+        munmap((void*)data, size);
+    }
+    return hash ? hash : 1;
+}
+
+static void meshCachePath(char* path, size_t size, uint64_t hash)
+{
+    snprintf(path, size, "%s/%016llx.mesh", MESH_CACHE_DIR, (unsigned long long)hash);
+}
+
+bool loadMeshCache(uint64_t hash, Mesh* mesh)
+{
+    char path[64];
+    meshCachePath(path, sizeof(path), hash);
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    MeshCacheHeader header;
+    bool loaded = false;
+    struct stat info;
+    if (fstat(fileno(fp), &info) == 0 && fread(&header, sizeof(header), 1, fp) == 1 && header.magic == MESH_CACHE_MAGIC
+        && header.version == MESH_CACHE_VERSION && header.stride == STRIDE && header.hash == hash
+        && (uint64_t)info.st_size == sizeof(header) + sizeof(float) * STRIDE * (uint64_t)header.numVertices
+                + sizeof(unsigned int) * (uint64_t)header.numIndices) {
+        float* vertices = malloc(sizeof(float) * STRIDE * (header.numVertices + 1));
+        unsigned int* indices = malloc(sizeof(unsigned int) * (header.numIndices + 1));
+        loaded = fread(vertices, sizeof(float) * STRIDE, header.numVertices, fp) == header.numVertices
+            && fread(indices, sizeof(unsigned int), header.numIndices, fp) == header.numIndices;
+        // A stale or damaged entry must not send the GPU outside the vertex buffer
+        for (uint32_t i = 0; loaded && i < header.numIndices; i++) {
+            if (indices[i] >= header.numVertices) {
+                printf("Mesh cache %s is corrupt, parsing the OBJ again\n", path);
+                loaded = false;
+            }
+        }
+        if (loaded) {
+            mesh->vertices = vertices;
+            mesh->numVertices = header.numVertices;
+            mesh->indices = indices;
+            mesh->numIndices = header.numIndices;
+        } else {
+            free(vertices);
+            free(indices);
+        }
+    }
+    fclose(fp);
+    return loaded;
+}
+
+void saveMeshCache(uint64_t hash, const Mesh* mesh)
+{
+    char path[64], temporary[72];
+    meshCachePath(path, sizeof(path), hash);
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid());
+
+    mkdir(MESH_CACHE_DIR, 0755);
+    FILE* fp = fopen(temporary, "wb");
+    if (fp == NULL) {
+        return;
+    }
+    MeshCacheHeader header = { MESH_CACHE_MAGIC, MESH_CACHE_VERSION, STRIDE, mesh->numVertices, mesh->numIndices, 0, hash };
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(mesh->vertices, sizeof(float) * STRIDE, mesh->numVertices, fp);
+    fwrite(mesh->indices, sizeof(unsigned int), mesh->numIndices, fp);
+    // Renamed into place so a cut-short write, or one from a second run, is never read back
+    if (fclose(fp) == 0) {
+        rename(temporary, path);
+    } else {
+        remove(temporary);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef __OBJLOADER_H__
+#define __OBJLOADER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "model.h"
+
+#define MESH_CACHE_DIR "meshcache" // Parsed and optimized meshes, keyed by the OBJ's contents
+#define MESH_CACHE_MAGIC 0x3148534Du // "MSH1"
+#define MESH_CACHE_VERSION 1
+
+// Header in front of every cached mesh: numVertices * STRIDE floats follow,
+// then numIndices indices
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t stride;
+    uint32_t numVertices;
+    uint32_t numIndices;
+    uint32_t reserved;
+    uint64_t hash;
+} MeshCacheHeader;
+
+// Parse a Wavefront OBJ into interleaved STRIDE vertices and triangle
+// indices. The file is mapped and split into line-aligned chunks that the
+// worker pool counts and then parses in parallel. Polygons are fanned into
+// triangles, and negative (relative) indices are resolved. A missing texture
+// coordinate reads as 0; missing normals are smoothed from the faces. Corners
+// with the same v/vt/vn share a vertex. Returns false if the file can't be read.
+bool loadOBJ(const char* filename, Mesh* mesh);
+
+// Hash of the file's contents and the vertex layout, 0 if it can't be read
+uint64_t hashMeshFile(const char* filename);
+
+// Fill vertices and indices from MESH_CACHE_DIR; false on a miss
+bool loadMeshCache(uint64_t hash, Mesh* mesh);
+void saveMeshCache(uint64_t hash, const Mesh* mesh);
+
+#endif
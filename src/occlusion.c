@@ -0,0 +1,121 @@
+#include "occlusion.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void initDepthPyramid(DepthPyramid* pyramid)
+{
+    memset(pyramid, 0, sizeof(DepthPyramid));
+}
+
+void destroyDepthPyramid(DepthPyramid* pyramid)
+{
+    for (int l = 0; l < HIZ_MAX_LEVELS; l++) {
+        free(pyramid->depth[l]);
+    }
+    initDepthPyramid(pyramid);
+}
+
+void buildDepthPyramid(DepthPyramid* pyramid, const float* base, int width, int height, mfloat_t* view, mfloat_t* projection)
+{
+    if (pyramid->width[0] != width || pyramid->height[0] != height) {
+        destroyDepthPyramid(pyramid);
+        int w = width, h = height;
+        while (pyramid->levels < HIZ_MAX_LEVELS) {
+            int l = pyramid->levels++;
+            pyramid->width[l] = w;
+            pyramid->height[l] = h;
+            pyramid->depth[l] = malloc(sizeof(float) * w * h);
+            if (w == 1 && h == 1) {
+                break;
+            }
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+    }
+
+    memcpy(pyramid->depth[0], base, sizeof(float) * width * height);
+    for (int l = 1; l < pyramid->levels; l++) {
+        const float* src = pyramid->depth[l - 1];
+        int sw = pyramid->width[l - 1], sh = pyramid->height[l - 1];
+        float* dst = pyramid->depth[l];
+        for (int y = 0; y < pyramid->height[l]; y++) {
+            int y0 = 2 * y, y1 = clampi(2 * y + 1, 0, sh - 1);
+            for (int x = 0; x < pyramid->width[l]; x++) {
+                int x0 = 2 * x, x1 = clampi(2 * x + 1, 0, sw - 1);
+                float a = MFMAX(src[y0 * sw + x0], src[y0 * sw + x1]);
+                float b = MFMAX(src[y1 * sw + x0], src[y1 * sw + x1]);
+                dst[y * pyramid->width[l] + x] = MFMAX(a, b);
+            }
+        }
+    }
+
+    memcpy(pyramid->view, view, sizeof(pyramid->view));
+    memcpy(pyramid->projection, projection, sizeof(pyramid->projection));
+    // Rigid view: eye = -R^T t
+    for (int i = 0; i < 3; i++) {
+        pyramid->eye[i] = -(view[4 * i] * view[12] + view[4 * i + 1] * view[13] + view[4 * i + 2] * view[14]);
+    }
+    pyramid->valid = true;
+}
+
+bool isSphereOccluded(const DepthPyramid* pyramid, const mfloat_t* eye, const mfloat_t* center, mfloat_t radius)
+{
+    if (!pyramid->valid) {
+        return false;
+    }
+    // Turning in place keeps every ray through the old eye, so only the
+    // translation since the capture can uncover the sphere
+    radius += vec3_distance((mfloat_t*)eye, (mfloat_t*)pyramid->eye);
+    const mfloat_t* v = pyramid->view;
+    const mfloat_t* p = pyramid->projection;
+
+    // View space center; the camera looks down -z
+    mfloat_t x = v[0] * center[0] + v[4] * center[1] + v[8] * center[2] + v[12];
+    mfloat_t y = v[1] * center[0] + v[5] * center[1] + v[9] * center[2] + v[13];
+    mfloat_t z = v[2] * center[0] + v[6] * center[1] + v[10] * center[2] + v[14];
+    mfloat_t d = -z;
+    mfloat_t nearPlane = p[14] / (p[10] - 1.0f);
+    if (d - radius <= nearPlane) {
+        return false;
+    }
+
+    // Conservative screen rectangle of the perspective silhouette
+    mfloat_t extent = radius * (MSQRT(x * x + y * y) + d) / (d - radius);
+    int w = pyramid->width[0], h = pyramid->height[0];
+    mfloat_t x0 = (p[0] * (x - extent) / d * 0.5f + 0.5f) * w;
+    mfloat_t x1 = (p[0] * (x + extent) / d * 0.5f + 0.5f) * w;
+    mfloat_t y0 = (p[5] * (y - extent) / d * 0.5f + 0.5f) * h;
+    mfloat_t y1 = (p[5] * (y + extent) / d * 0.5f + 0.5f) * h;
+    if (x0 < 0 || y0 < 0 || x1 >= w || y1 >= h) {
+        return false; // Partly off screen last frame, nothing to compare against
+    }
+
+    // Window depth of the sphere's nearest point
+    mfloat_t zn = z + radius;
+    mfloat_t nearest = (p[10] * zn + p[14]) / -zn * 0.5f + 0.5f;
+
+    // Pick the level where the rectangle spans at most 2x2 texels
+    mfloat_t span = MFMAX(x1 - x0, y1 - y0);
+    int level = 0;
+    while (level < pyramid->levels - 1 && span > 2.0f) {
+        span *= 0.5f;
+        level++;
+    }
+    mfloat_t scale = 1.0f / (1 << level);
+    int lw = pyramid->width[level], lh = pyramid->height[level];
+    int tx0 = clampi((int)(x0 * scale), 0, lw - 1);
+    int tx1 = clampi((int)(x1 * scale), 0, lw - 1);
+    int ty0 = clampi((int)(y0 * scale), 0, lh - 1);
+    int ty1 = clampi((int)(y1 * scale), 0, lh - 1);
+
+    const float* depth = pyramid->depth[level];
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            if (nearest <= depth[ty * lw + tx]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+#include <stdbool.h>
+
+#include "mathc.h"
+
+#define HIZ_MAX_LEVELS 12
+
+// Max-reduced window-space depth of an earlier frame, with the camera that
+// produced it. Level 0 is the coarse base read back from the GPU; every next
+// level halves the resolution and keeps the farthest depth of its 2x2 block.
+typedef struct {
+    int levels;
+    int width[HIZ_MAX_LEVELS];
+    int height[HIZ_MAX_LEVELS];
+    float* depth[HIZ_MAX_LEVELS];
+    mfloat_t view[MAT4_SIZE];
+    mfloat_t projection[MAT4_SIZE];
+    mfloat_t eye[VEC3_SIZE]; // Camera position of view
+    bool valid;
+} DepthPyramid;
+
+void initDepthPyramid(DepthPyramid* pyramid);
+void destroyDepthPyramid(DepthPyramid* pyramid);
+
+// Takes a copy of base (width * height, row 0 at the bottom)
+void buildDepthPyramid(DepthPyramid* pyramid, const float* base, int width, int height, mfloat_t* view, mfloat_t* projection);
+
+// True when the sphere is behind the recorded depth everywhere it could cover.
+// eye is the current camera position; the sphere is grown by how far the
+// camera moved since the capture, so a moving camera culls less, never wrongly.
+bool isSphereOccluded(const DepthPyramid* pyramid, const mfloat_t* eye, const mfloat_t* center, mfloat_t radius);
+
+#endif
@@ -0,0 +1,157 @@
+#include "particles.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+ParticleStore* createParticleStore(int capacity)
+{
+    ParticleStore* store = malloc(sizeof(ParticleStore));
+    store->objects = malloc(sizeof(VerletObject) * capacity);
+    store->owners = malloc(sizeof(uint32_t) * capacity);
+    store->dense = malloc(sizeof(uint32_t) * capacity);
+    store->generations = calloc(capacity, sizeof(uint32_t));
+    store->freeSlots = malloc(sizeof(uint32_t) * capacity);
+    store->numFree = 0;
+    store->numSlots = 0;
+    store->count = 0;
+    store->capacity = capacity;
+    return store;
+}
+
+void destroyParticleStore(ParticleStore* store)
+{
+    free(store->objects);
+    free(store->owners);
+    free(store->dense);
+    free(store->generations);
+    free(store->freeSlots);
+    free(store);
+}
+
+ParticleHandle insertParticle(ParticleStore* store, const VerletObject* obj)
+{
+    if (store->count >= store->capacity) {
+        return NULL_HANDLE; // Cannot spawn more objects
+    }
+
+    // Reuse a released slot before handing out a fresh one
+    uint32_t slot;
+    if (store->numFree > 0) {
+        slot = store->freeSlots[--store->numFree];
+    } else {
+        slot = store->numSlots++;
+    }
+
+    int index = store->count++;
+    store->objects[index] = *obj;
+    store->owners[index] = slot;
+    store->dense[slot] = index;
+
+    return (ParticleHandle) { slot, store->generations[slot] };
+}
+
+ParticleHandle spawnParticle(ParticleStore* store, mfloat_t* position, mfloat_t* velocity, ParticleColor color, mfloat_t radius, mfloat_t lifetime)
+{
+    VerletObject obj;
+    vec3(obj.current, position[0], position[1], position[2]);
+    vec3(obj.previous, position[0] - velocity[0], position[1] - velocity[1], position[2] - velocity[2]);
+    vec3(obj.acceleration, 0, 0, 0);
+    obj.radius = radius;
+    obj.color = color;
+    setColorVector(&obj);
+    // Initialize mass from color
+    setMassFromColor(&obj);
+    obj.lifetime = lifetime;
+    return insertParticle(store, &obj);
+}
+
+void despawnIndex(ParticleStore* store, int index)
+{
+    uint32_t slot = store->owners[index];
+    int last = --store->count;
+
+    // Move the last particle into the hole so the array stays dense
+    if (index != last) {
+        store->objects[index] = store->objects[last];
+        store->owners[index] = store->owners[last];
+        store->dense[store->owners[index]] = index;
+    }
+
+    // Invalidate outstanding handles and recycle the slot
+    store->dense[slot] = INVALID_SLOT;
+    store->generations[slot]++;
+    store->freeSlots[store->numFree++] = slot;
+}
+
+bool despawnParticle(ParticleStore* store, ParticleHandle handle)
+{
+    if (!isHandleValid(store, handle)) {
+        return false;
+    }
+    despawnIndex(store, store->dense[handle.slot]);
+    return true;
+}
+
+void clearParticles(ParticleStore* store)
+{
+    while (store->count > 0) {
+        despawnIndex(store, store->count - 1);
+    }
+}
+
+bool isHandleValid(const ParticleStore* store, ParticleHandle handle)
+{
+    return handle.slot < (uint32_t)store->numSlots
+        && store->generations[handle.slot] == handle.generation
+        && store->dense[handle.slot] != INVALID_SLOT;
+}
+
+VerletObject* getParticle(ParticleStore* store, ParticleHandle handle)
+{
+    if (!isHandleValid(store, handle)) {
+        return NULL;
+    }
+    return &store->objects[store->dense[handle.slot]];
+}
+
+ParticleHandle handleAtIndex(const ParticleStore* store, int index)
+{
+    uint32_t slot = store->owners[index];
+    return (ParticleHandle) { slot, store->generations[slot] };
+}
+
+// Both bulk passes walk backwards so the particle swapped into a hole has
+// already been visited.
+int despawnExpired(ParticleStore* store, float dt)
+{
+    int removed = 0;
+    for (int i = store->count - 1; i >= 0; i--) {
+        VerletObject* obj = &store->objects[i];
+        if (obj->lifetime <= 0) {
+            continue; // Immortal
+        }
+        obj->lifetime -= dt;
+        if (obj->lifetime <= 0) {
+            despawnIndex(store, i);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+int applySinks(ParticleStore* store, const ParticleSink* sinks, int numSinks)
+{
+    int removed = 0;
+    for (int i = store->count - 1; i >= 0; i--) {
+        VerletObject* obj = &store->objects[i];
+        for (int s = 0; s < numSinks; s++) {
+            mfloat_t reach = sinks[s].radius + obj->radius;
+            if (vec3_distance_squared(obj->current, (mfloat_t*)sinks[s].center) < reach * reach) {
+                despawnIndex(store, i);
+                removed++;
+                break;
+            }
+        }
+    }
+    return removed;
+}
@@ -0,0 +1,61 @@
+#ifndef __PARTICLES_H__
+#define __PARTICLES_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "verlet.h"
+
+#define INVALID_SLOT 0xFFFFFFFFu
+
+// Generational handle to a particle. The slot indexes the indirection table and
+// the generation is bumped every time the slot is released, so a handle kept
+// past its particle's despawn is detected as stale instead of aliasing a new one.
+typedef struct {
+    uint32_t slot;
+    uint32_t generation;
+} ParticleHandle;
+
+#define NULL_HANDLE ((ParticleHandle) { INVALID_SLOT, 0 })
+
+// Spherical region that removes every particle entering it
+typedef struct {
+    mfloat_t center[VEC3_SIZE];
+    mfloat_t radius;
+} ParticleSink;
+
+// Dense particle storage. objects[0, count) is always packed so the kernels in
+// verlet.c keep iterating 0..count; handles reach a particle through slots.
+typedef struct {
+    VerletObject* objects;
+    uint32_t* owners;      // dense index -> slot
+    uint32_t* dense;       // slot -> dense index (INVALID_SLOT when free)
+    uint32_t* generations; // slot -> current generation
+    uint32_t* freeSlots;   // stack of released slots
+    int numFree;
+    int numSlots;          // slots handed out so far
+    int count;
+    int capacity;
+} ParticleStore;
+
+ParticleStore* createParticleStore(int capacity);
+void destroyParticleStore(ParticleStore* store);
+
+// Copy an initialized object into the store. Returns NULL_HANDLE when full.
+ParticleHandle insertParticle(ParticleStore* store, const VerletObject* obj);
+ParticleHandle spawnParticle(ParticleStore* store, mfloat_t* position, mfloat_t* velocity, ParticleColor color, mfloat_t radius, mfloat_t lifetime);
+
+// O(1) swap-remove. Returns false if the handle is stale.
+bool despawnParticle(ParticleStore* store, ParticleHandle handle);
+void despawnIndex(ParticleStore* store, int index);
+void clearParticles(ParticleStore* store);
+
+bool isHandleValid(const ParticleStore* store, ParticleHandle handle);
+VerletObject* getParticle(ParticleStore* store, ParticleHandle handle);
+ParticleHandle handleAtIndex(const ParticleStore* store, int index);
+
+// Bulk removal; both return how many particles were despawned
+int despawnExpired(ParticleStore* store, float dt);
+int applySinks(ParticleStore* store, const ParticleSink* sinks, int numSinks);
+
+#endif
@@ -0,0 +1,294 @@
+#define _POSIX_C_SOURCE 200809L // mmap, posix_madvise
+
+#include "playback.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "varint.h"
+
+#define MAX_SLOTS (1 << 26) // Anything larger is a corrupt record
+
+static void addChunk(Playback* playback, const TrajectoryChunk* chunk, int* capacity)
+{
+    if (playback->numChunks == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        playback->chunks = realloc(playback->chunks, sizeof(PlaybackChunk) * *capacity);
+    }
+    PlaybackChunk* entry = &playback->chunks[playback->numChunks++];
+    entry->frames = (const unsigned char*)(chunk + 1);
+    entry->end = entry->frames + chunk->bytes;
+    entry->firstFrame = playback->numFrames;
+    entry->numFrames = chunk->numFrames;
+    playback->numFrames += chunk->numFrames;
+}
+
+static bool isChunk(const Playback* playback, uint64_t offset)
+{
+    if (offset + sizeof(TrajectoryChunk) > playback->size) {
+        return false;
+    }
+    const TrajectoryChunk* chunk = (const TrajectoryChunk*)(playback->data + offset);
+    return chunk->magic == TRAJECTORY_CHUNK_MAGIC && offset + sizeof(TrajectoryChunk) + chunk->bytes <= playback->size;
+}
+
+static void buildIndex(Playback* playback)
+{
+    int capacity = 0;
+
+    // The footer's index when the recording was closed properly
+    if (playback->size >= sizeof(TrajectoryHeader) + sizeof(TrajectoryFooter)) {
+        const TrajectoryFooter* footer = (const TrajectoryFooter*)(playback->data + playback->size - sizeof(TrajectoryFooter));
+        uint64_t indexBytes = sizeof(TrajectoryIndexEntry) * (uint64_t)footer->numChunks;
+        if (footer->magic == TRAJECTORY_INDEX_MAGIC && footer->indexOffset + indexBytes + sizeof(TrajectoryFooter) == playback->size) {
+            const TrajectoryIndexEntry* index = (const TrajectoryIndexEntry*)(playback->data + footer->indexOffset);
+            for (uint32_t c = 0; c < footer->numChunks && isChunk(playback, index[c].offset); c++) {
+                addChunk(playback, (const TrajectoryChunk*)(playback->data + index[c].offset), &capacity);
+            }
+            return;
+        }
+    }
+
+    // Cut short: walk the chunks from the front
+    uint64_t offset = sizeof(TrajectoryHeader);
+    while (isChunk(playback, offset)) {
+        const TrajectoryChunk* chunk = (const TrajectoryChunk*)(playback->data + offset);
+        addChunk(playback, chunk, &capacity);
+        offset += sizeof(TrajectoryChunk) + chunk->bytes;
+    }
+    printf("Trajectory has no index, found %d chunks\n", playback->numChunks);
+}
+
+static void growSlots(Playback* playback, int slots)
+{
+    int capacity = playback->capacity ? playback->capacity : 1024;
+    while (capacity < slots) {
+        capacity *= 2;
+    }
+    playback->quantized = realloc(playback->quantized, sizeof(int32_t) * 3 * capacity);
+    playback->positions = realloc(playback->positions, sizeof(mfloat_t) * VEC3_SIZE * capacity);
+    playback->species = realloc(playback->species, sizeof(uint8_t) * capacity);
+    playback->decodedFrame = realloc(playback->decodedFrame, sizeof(int) * capacity);
+    for (int s = playback->capacity; s < capacity; s++) {
+        playback->decodedFrame[s] = -1;
+    }
+    playback->capacity = capacity;
+}
+
+// Decode the frame at the cursor; only the target of a seek fills the snapshot.
+// False when the frame runs past the end of its chunk or names an absurd slot.
+static bool decodeFrame(Playback* playback, bool fill)
+{
+    const TrajectoryHeader* header = playback->header;
+    const mfloat_t step = 2.0f * header->range / ((1 << header->bits) - 1);
+    SimSnapshot* snapshot = &playback->snapshot;
+
+    const unsigned char* in = playback->cursor;
+    const unsigned char* end = playback->chunks[playback->chunk].end;
+    uint64_t frameStep, count;
+    mfloat_t container[VEC3_SIZE];
+    if (!(in = getVarintBounded(in, end, &frameStep)) || !(in = getVarintBounded(in, end, &count))
+        || end - in < (ptrdiff_t)sizeof(container) || count > MAX_SLOTS) {
+        return false;
+    }
+    memcpy(container, in, sizeof(container));
+    in += sizeof(container);
+
+    int frame = ++playback->frame;
+    bool chunkStart = frame == playback->chunks[playback->chunk].firstFrame;
+    if (fill && (int)count > playback->snapshotCapacity) {
+        playback->snapshotCapacity = count;
+        snapshot->objects = realloc(snapshot->objects, sizeof(VerletObject) * count);
+        snapshot->origins = realloc(snapshot->origins, sizeof(mfloat_t) * VEC3_SIZE * count);
+    }
+
+    int64_t slot = 0;
+    int decoded = 0;
+    for (; decoded < (int)count; decoded++) {
+        uint64_t value;
+        if (!(in = getVarintBounded(in, end, &value))) {
+            return false;
+        }
+        slot += unzigzag(value >> 1);
+        bool key = value & 1;
+        if (slot < 0 || slot >= MAX_SLOTS) {
+            return false;
+        }
+        if (slot >= playback->capacity) {
+            growSlots(playback, slot + 1);
+        }
+        int32_t* quantized = &playback->quantized[slot * 3];
+        if (key) {
+            uint64_t species;
+            if (!(in = getVarintBounded(in, end, &species))) {
+                return false;
+            }
+            playback->species[slot] = species;
+            quantized[0] = quantized[1] = quantized[2] = 0;
+        }
+
+        mfloat_t position[VEC3_SIZE];
+        for (int a = 0; a < 3; a++) {
+            if (!(in = getVarintBounded(in, end, &value))) {
+                return false;
+            }
+            quantized[a] += unzigzag(value);
+            position[a] = quantized[a] * step - header->range + container[a];
+        }
+
+        mfloat_t* previous = &playback->positions[slot * VEC3_SIZE];
+        if (fill) {
+            // A key record inside a chunk is a new particle, not the slot's old one
+            bool continued = playback->decodedFrame[slot] == frame - 1 && (!key || chunkStart);
+            mfloat_t* origin = &snapshot->origins[decoded * VEC3_SIZE];
+            vec3_assign(origin, continued ? previous : position);
+
+            VerletObject* obj = &snapshot->objects[decoded];
+            for (int a = 0; a < 3; a++) {
+                obj->current[a] = position[a];
+                // One substep of travel, which is what the renderer reads as speed
+                obj->previous[a] = position[a] - (position[a] - origin[a]) / SIM_SUBSTEPS;
+                obj->acceleration[a] = 0.0f;
+            }
+            obj->radius = VERLET_RADIUS;
+            obj->color = playback->species[slot];
+            setColorVector(obj);
+            setMassFromColor(obj);
+            obj->lifetime = 0.0f;
+        }
+        vec3_assign(previous, position);
+        playback->decodedFrame[slot] = frame;
+    }
+    playback->cursor = in;
+
+    if (fill) {
+        snapshot->count = decoded;
+        snapshot->step = frameStep;
+        vec3_assign(snapshot->containerPosition, container);
+    }
+    return true;
+}
+
+// Decode every frame once, so seeking never meets a chunk that runs over.
+// Leaves the decoder as a freshly opened file has it.
+static bool validateFrames(Playback* playback)
+{
+    for (int c = 0; c < playback->numChunks; c++) {
+        playback->chunk = c;
+        playback->cursor = playback->chunks[c].frames;
+        playback->frame = playback->chunks[c].firstFrame - 1;
+        for (int f = 0; f < playback->chunks[c].numFrames; f++) {
+            if (!decodeFrame(playback, false)) {
+                printf("Trajectory chunk %d is corrupt at frame %d\n", c, playback->frame + 1);
+                return false;
+            }
+        }
+    }
+    for (int s = 0; s < playback->capacity; s++) {
+        playback->decodedFrame[s] = -1;
+    }
+    playback->chunk = 0;
+    playback->cursor = NULL;
+    playback->frame = -1;
+    return true;
+}
+
+Playback* openPlayback(const char* path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open trajectory %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(TrajectoryHeader)) {
+        printf("Trajectory %s is too short\n", path);
+        close(fd);
+        return NULL;
+    }
+    const unsigned char* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("Failed to map trajectory %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    const TrajectoryHeader* header = (const TrajectoryHeader*)data;
+    if (header->magic != TRAJECTORY_MAGIC || header->version != TRAJECTORY_VERSION) {
+        printf("%s is not a version %d trajectory\n", path, TRAJECTORY_VERSION);
+        munmap((void*)data, info.st_size);
+        return NULL;
+    }
+    // Scrubbing jumps around the file
+    posix_madvise((void*)data, info.st_size, POSIX_MADV_RANDOM);
+
+    Playback* playback = malloc(sizeof(Playback));
+    memset(playback, 0, sizeof(Playback));
+    playback->data = data;
+    playback->size = info.st_size;
+    playback->header = header;
+    playback->frame = -1;
+    buildIndex(playback);
+    if (playback->numFrames == 0) {
+        printf("Trajectory %s has no frames\n", path);
+        closePlayback(playback);
+        return NULL;
+    }
+    if (!validateFrames(playback)) {
+        closePlayback(playback);
+        return NULL;
+    }
+    return playback;
+}
+
+void closePlayback(Playback* playback)
+{
+    munmap((void*)playback->data, playback->size);
+    free(playback->chunks);
+    free(playback->quantized);
+    free(playback->positions);
+    free(playback->species);
+    free(playback->decodedFrame);
+    free(playback->snapshot.objects);
+    free(playback->snapshot.origins);
+    free(playback);
+}
+
+const SimSnapshot* seekPlayback(Playback* playback, int frame)
+{
+    if (playback->numFrames == 0) {
+        return &playback->snapshot;
+    }
+    frame = clampi(frame, 0, playback->numFrames - 1);
+    if (frame == playback->frame) {
+        return &playback->snapshot;
+    }
+
+    // Keep decoding forward inside the current chunk, otherwise restart at
+    // the keyframe of the chunk holding the target
+    const PlaybackChunk* current = &playback->chunks[playback->chunk];
+    bool ahead = playback->frame >= 0 && frame > playback->frame && frame < current->firstFrame + current->numFrames;
+    if (!ahead) {
+        int lo = 0, hi = playback->numChunks - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (playback->chunks[mid].firstFrame <= frame) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        playback->chunk = lo;
+        playback->cursor = playback->chunks[lo].frames;
+        playback->frame = playback->chunks[lo].firstFrame - 1;
+    }
+    while (playback->frame < frame) {
+        decodeFrame(playback, playback->frame + 1 == frame);
+    }
+    return &playback->snapshot;
+}
@@ -0,0 +1,52 @@
+#ifndef __PLAYBACK_H__
+#define __PLAYBACK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "simulation.h"
+#include "trajectory.h"
+
+typedef struct {
+    const unsigned char* frames; // First encoded frame
+    const unsigned char* end;    // Past the chunk's last byte
+    int firstFrame;              // Frame number across the whole file
+    int numFrames;
+} PlaybackChunk;
+
+// A recorded trajectory, memory mapped and decoded on demand. Stepping to the
+// next frame decodes one frame; any other seek restarts at the chunk holding
+// the target, so it never decodes more than TRAJECTORY_CHUNK frames.
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+    const TrajectoryHeader* header;
+    PlaybackChunk* chunks;
+    int numChunks;
+    int numFrames;
+
+    // Decoder state per slot, grown to the largest slot seen
+    int capacity;
+    int32_t* quantized;  // Position within the chunk being decoded
+    mfloat_t* positions; // Decoded position
+    uint8_t* species;    // Only stored on key records
+    int* decodedFrame;   // Frame the slot was last decoded in
+    int chunk;
+    const unsigned char* cursor; // Next frame of that chunk
+    int frame;                   // Last decoded frame, -1 before any
+
+    // The decoded frame in the shape the renderer takes from the simulation
+    SimSnapshot snapshot;
+    int snapshotCapacity;
+} Playback;
+
+// NULL if the file can't be mapped, is not a trajectory, holds no frames or
+// has a chunk whose frames run past its end
+Playback* openPlayback(const char* path);
+void closePlayback(Playback* playback);
+
+// Decode frame (clamped to the recording). origins hold the frame before, so
+// the result interpolates like a simulation snapshot.
+const SimSnapshot* seekPlayback(Playback* playback, int frame);
+
+#endif
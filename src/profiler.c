@@ -0,0 +1,316 @@
+#include "profiler.h"
+#include "scheduler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROFILE_REPORT_INTERVAL 0.25 // Seconds between report refreshes
+
+const char* profileZoneNames[PROFILE_ZONES] = {
+    "forces", "grid", "collisions", "constraints", "integration", "pack", "upload", "draw", "hud", "swap"
+};
+const float profileWindowSeconds[PROFILE_WINDOWS] = { 1.0f, 10.0f };
+
+typedef struct {
+    double time; // monotonicTime() at the end of the frame
+    float frameMs;
+    float ms[PROFILE_TRACKS][PROFILE_ZONES];
+} ProfileFrame;
+
+// Each track's row is written only by the thread working on it. totals only
+// grow, so the main thread takes a frame's share as the change since it last looked.
+static uint64_t opened[PROFILE_TRACKS][PROFILE_ZONES];
+static uint64_t totals[PROFILE_TRACKS][PROFILE_ZONES];
+
+// Main thread only
+static uint64_t seen[PROFILE_TRACKS][PROFILE_ZONES];
+static ProfileFrame history[PROFILE_HISTORY];
+static int numFrames = 0;
+static int newest = -1;
+static double lastFrame = 0.0;
+static double lastReport = 0.0;
+static float values[PROFILE_HISTORY];
+
+typedef struct {
+    uint64_t begin;
+    uint64_t end;
+    int zone;
+} TraceEvent;
+
+// A capture appends to one buffer per track, written only by that track's
+// thread and published through its count. They are serialized once the
+// capture is over, so writing the file never lands in a traced frame.
+// Every capture bumps the generation, and each track empties its own buffer
+// the first time it records under a new one.
+static int tracing = 0;
+static int traceGeneration = 0;
+static TraceEvent* traceEvents[PROFILE_TRACKS];
+static int traceCounts[PROFILE_TRACKS];
+static int traceDropped[PROFILE_TRACKS];
+static int traceSeen[PROFILE_TRACKS]; // Generation the track last emptied its buffer for
+
+// Main thread only
+static uint64_t traceStart;
+static uint64_t traceFrameEnds[PROFILE_TRACE_MAX_FRAMES];
+static int traceFrames = 0;
+static int traceFramesLeft = 0;
+static int traceNumber = 0;
+
+static uint64_t now()
+{
+    return (uint64_t)(monotonicTime() * 1e9);
+}
+
+void profileTrackName(int track, char* name, int size)
+{
+    if (track == PROFILE_MAIN) {
+        snprintf(name, size, "main");
+    } else if (track == PROFILE_SIM) {
+        snprintf(name, size, "sim");
+    } else {
+        snprintf(name, size, "worker %d", track - PROFILE_WORKERS);
+    }
+}
+
+void profileBegin(int track, ProfileZone zone)
+{
+    opened[track][zone] = now();
+}
+
+static void record(int track, ProfileZone zone, uint64_t begin, uint64_t end)
+{
+    __atomic_fetch_add(&totals[track][zone], end - begin, __ATOMIC_RELAXED);
+    if (!__atomic_load_n(&tracing, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    int generation = __atomic_load_n(&traceGeneration, __ATOMIC_ACQUIRE);
+    if (traceSeen[track] != generation) {
+        __atomic_store_n(&traceCounts[track], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&traceDropped[track], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&traceSeen[track], generation, __ATOMIC_RELEASE);
+    }
+    int n = traceCounts[track];
+    if (n == PROFILE_TRACE_EVENTS) {
+        __atomic_store_n(&traceDropped[track], traceDropped[track] + 1, __ATOMIC_RELEASE);
+        return;
+    }
+    traceEvents[track][n] = (TraceEvent) { begin, end, zone };
+    __atomic_store_n(&traceCounts[track], n + 1, __ATOMIC_RELEASE);
+}
+
+void profileEnd(int track, ProfileZone zone)
+{
+    record(track, zone, opened[track][zone], now());
+}
+
+void profileSpan(int track, ProfileZone zone, double begin, double end)
+{
+    record(track, zone, (uint64_t)(begin * 1e9), (uint64_t)(end * 1e9));
+}
+
+// age 0 is the newest frame
+static const ProfileFrame* frameAt(int age)
+{
+    return &history[(newest - age + PROFILE_HISTORY) % PROFILE_HISTORY];
+}
+
+static int compareFloats(const void* a, const void* b)
+{
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts values in place
+static float percentile(float* v, int n, float p)
+{
+    if (n == 0) {
+        return 0.0f;
+    }
+    qsort(v, n, sizeof(float), compareFloats);
+    return v[(int)(p * (n - 1) + 0.5f)];
+}
+
+static void buildReport(ProfileReport* report, double time)
+{
+    memset(report, 0, sizeof(ProfileReport));
+    for (int w = 0; w < PROFILE_WINDOWS; w++) {
+        int n = 0;
+        while (n < numFrames && time - frameAt(n)->time < profileWindowSeconds[w]) {
+            n++;
+        }
+        report->frames[w] = n;
+    }
+
+    for (int i = 0; i < report->frames[0]; i++) {
+        const ProfileFrame* frame = frameAt(i);
+        for (int t = 0; t < PROFILE_TRACKS; t++) {
+            for (int z = 0; z < PROFILE_ZONES; z++) {
+                report->meanMs[t][z] += frame->ms[t][z] / report->frames[0];
+            }
+        }
+    }
+    const ProfileFrame* slowest = NULL;
+    for (int i = 0; i < report->frames[PROFILE_WINDOWS - 1]; i++) {
+        if (slowest == NULL || frameAt(i)->frameMs > slowest->frameMs) {
+            slowest = frameAt(i);
+        }
+    }
+    if (slowest) {
+        memcpy(report->slowestMs, slowest->ms, sizeof(report->slowestMs));
+        report->slowestFrameMs = slowest->frameMs;
+    }
+
+    for (int w = 0; w < PROFILE_WINDOWS; w++) {
+        int n = report->frames[w];
+        for (int i = 0; i < n; i++) {
+            values[i] = frameAt(i)->frameMs;
+        }
+        report->frameP50[w] = percentile(values, n, 0.50f);
+        report->frameP99[w] = percentile(values, n, 0.99f);
+        for (int z = 0; z < PROFILE_ZONES; z++) {
+            for (int i = 0; i < n; i++) {
+                values[i] = frameAt(i)->ms[PROFILE_MAIN][z] + frameAt(i)->ms[PROFILE_SIM][z];
+            }
+            report->zoneP50[w][z] = percentile(values, n, 0.50f);
+            report->zoneP99[w][z] = percentile(values, n, 0.99f);
+        }
+    }
+
+    // Both histograms share bins reaching a little past the long window's p99;
+    // anything slower lands in the last one
+    report->binMs = report->frameP99[PROFILE_WINDOWS - 1] * 1.25f / PROFILE_BINS;
+    if (report->binMs <= 0.0f) {
+        return;
+    }
+    for (int w = 0; w < PROFILE_WINDOWS; w++) {
+        for (int i = 0; i < report->frames[w]; i++) {
+            int bin = (int)(frameAt(i)->frameMs / report->binMs);
+            report->histogram[w][bin < PROFILE_BINS ? bin : PROFILE_BINS - 1]++;
+        }
+    }
+}
+
+void profileCapture(int frames)
+{
+    if (tracing) {
+        return;
+    }
+    for (int t = 0; t < PROFILE_TRACKS; t++) {
+        if (traceEvents[t] == NULL) {
+            traceEvents[t] = malloc(sizeof(TraceEvent) * PROFILE_TRACE_EVENTS);
+        }
+    }
+    traceFrames = 0;
+    traceFramesLeft = frames < 1 ? 1 : frames > PROFILE_TRACE_MAX_FRAMES ? PROFILE_TRACE_MAX_FRAMES : frames;
+    traceStart = now();
+    // Buffers and generation are visible to every track that sees the capture start
+    __atomic_store_n(&traceGeneration, traceGeneration + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&tracing, 1, __ATOMIC_RELEASE);
+    printf("Tracing the next %d frames\n", traceFramesLeft);
+}
+
+// Trace thread ids: every profiler track, the upload path and the frames
+#define TRACE_TID(track) ((track) + 1)
+#define TRACE_UPLOAD_TID (PROFILE_TRACKS + 1)
+#define TRACE_FRAMES_TID (PROFILE_TRACKS + 2)
+
+static void writeThreadName(FILE* fp, int tid, const char* name, int order)
+{
+    fprintf(fp, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s\"}},\n",
+        tid, name);
+    fprintf(fp, "{\"name\": \"thread_sort_index\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"sort_index\": %d}},\n",
+        tid, order);
+}
+
+static void writeSlice(FILE* fp, const char* name, const char* category, int tid, uint64_t begin, uint64_t end)
+{
+    fprintf(fp, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f},\n",
+        name, category, tid, (begin - traceStart) * 1e-3, (end - begin) * 1e-3);
+}
+
+static void writeTrace()
+{
+    char path[32];
+    snprintf(path, sizeof(path), "trace-%d.json", ++traceNumber);
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) {
+        printf("Couldn't open file %s\n", path);
+        return;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    writeThreadName(fp, TRACE_FRAMES_TID, "frames", 0);
+    writeThreadName(fp, TRACE_TID(PROFILE_MAIN), "main", 1);
+    writeThreadName(fp, TRACE_UPLOAD_TID, "upload", 2);
+    for (int t = PROFILE_SIM; t < PROFILE_TRACKS; t++) {
+        char name[32];
+        profileTrackName(t, name, sizeof(name));
+        writeThreadName(fp, TRACE_TID(t), name, t + 2);
+    }
+
+    uint64_t begin = traceStart;
+    for (int f = 0; f < traceFrames; f++) {
+        char name[32];
+        snprintf(name, sizeof(name), "frame %d", f);
+        writeSlice(fp, name, "frame", TRACE_FRAMES_TID, begin, traceFrameEnds[f]);
+        begin = traceFrameEnds[f];
+    }
+    int events = 0, dropped = 0;
+    for (int t = 0; t < PROFILE_TRACKS; t++) {
+        if (__atomic_load_n(&traceSeen[t], __ATOMIC_ACQUIRE) != traceGeneration) {
+            continue; // Nothing recorded this capture; the buffer still holds an older one
+        }
+        int count = __atomic_load_n(&traceCounts[t], __ATOMIC_ACQUIRE);
+        dropped += __atomic_load_n(&traceDropped[t], __ATOMIC_ACQUIRE);
+        for (int i = 0; i < count; i++) {
+            const TraceEvent* event = &traceEvents[t][i];
+            if (event->begin < traceStart) {
+                continue; // Opened before the capture
+            }
+            // Instance stream waits and transfers get a track of their own
+            int tid = event->zone == PROFILE_UPLOAD ? TRACE_UPLOAD_TID : TRACE_TID(t);
+            const char* category = event->zone <= PROFILE_INTEGRATION ? "simulation" : "render";
+            writeSlice(fp, profileZoneNames[event->zone], category, tid, event->begin, event->end);
+            events++;
+        }
+    }
+    // Closing metadata record, so every event above can end with a comma
+    fprintf(fp, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"verlet\"}}\n]}\n");
+    fclose(fp);
+    printf("Wrote %s: %d frames, %d events, %d dropped\n", path, traceFrames, events, dropped);
+}
+
+void profileFrame(ProfileReport* report)
+{
+    double time = monotonicTime();
+    if (lastFrame > 0.0) {
+        newest = (newest + 1) % PROFILE_HISTORY;
+        numFrames += numFrames < PROFILE_HISTORY;
+        ProfileFrame* frame = &history[newest];
+        frame->time = time;
+        frame->frameMs = (time - lastFrame) * 1000.0;
+        for (int t = 0; t < PROFILE_TRACKS; t++) {
+            for (int z = 0; z < PROFILE_ZONES; z++) {
+                uint64_t total = __atomic_load_n(&totals[t][z], __ATOMIC_RELAXED);
+                frame->ms[t][z] = (total - seen[t][z]) * 1e-6f;
+                seen[t][z] = total;
+            }
+        }
+    }
+    lastFrame = time;
+
+    if (tracing) {
+        traceFrameEnds[traceFrames++] = now();
+        if (--traceFramesLeft == 0) {
+            __atomic_store_n(&tracing, 0, __ATOMIC_RELEASE);
+            writeTrace();
+        }
+    }
+
+    if (time - lastReport >= PROFILE_REPORT_INTERVAL) {
+        lastReport = time;
+        buildReport(report, time);
+    }
+    report->tracing = tracing;
+}
@@ -0,0 +1,98 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "workers.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Timed parts of a frame. The first five run once per substep on the
+// simulation thread; collisions and packing also run on every pool worker.
+typedef enum {
+    PROFILE_FORCES,
+    PROFILE_GRID,
+    PROFILE_COLLISIONS,
+    PROFILE_CONSTRAINTS,
+    PROFILE_INTEGRATION,
+    PROFILE_PACK,
+    PROFILE_UPLOAD,
+    PROFILE_DRAW,
+    PROFILE_HUD,
+    PROFILE_SWAP,
+    PROFILE_ZONES
+} ProfileZone;
+
+// Who did the work. Worker 0 of the pool is whichever thread submitted the job.
+typedef enum {
+    PROFILE_MAIN,
+    PROFILE_SIM,
+    PROFILE_WORKERS, // PROFILE_WORKERS + worker, for every worker of the pool
+    PROFILE_TRACKS = PROFILE_WORKERS + THREAD_COUNT
+} ProfileTrack;
+
+#define PROFILE_WINDOWS 2   // Report windows: the last second and the last ten
+#define PROFILE_BINS 32     // Frame-time histogram resolution
+#define PROFILE_HISTORY 2048 // Frames kept, ten seconds at up to 200 fps
+#define PROFILE_TRACE_FRAMES 120      // Default length of a trace capture
+#define PROFILE_TRACE_MAX_FRAMES 1200
+#define PROFILE_TRACE_EVENTS (1 << 15) // Per track per capture; later ones are dropped
+
+extern const char* profileZoneNames[PROFILE_ZONES];
+extern const float profileWindowSeconds[PROFILE_WINDOWS];
+
+// What the HUD shows, refreshed a few times a second. Times are milliseconds
+// per frame; a zone's percentiles count its main and simulation thread time.
+typedef struct {
+    float meanMs[PROFILE_TRACKS][PROFILE_ZONES];    // Over the last second
+    float slowestMs[PROFILE_TRACKS][PROFILE_ZONES]; // The slowest frame of the last ten seconds
+    float slowestFrameMs;
+    float frameP50[PROFILE_WINDOWS];
+    float frameP99[PROFILE_WINDOWS];
+    float zoneP50[PROFILE_WINDOWS][PROFILE_ZONES];
+    float zoneP99[PROFILE_WINDOWS][PROFILE_ZONES];
+    float histogram[PROFILE_WINDOWS][PROFILE_BINS]; // Frames per bin of frame time
+    float binMs;
+    int frames[PROFILE_WINDOWS];
+    bool tracing; // A trace capture is running
+} ProfileReport;
+
+void profileTrackName(int track, char* name, int size);
+
+// Only the thread doing the work may open and close a zone on its track
+void profileBegin(int track, ProfileZone zone);
+void profileEnd(int track, ProfileZone zone);
+// Same for a span the caller already timed, in monotonicTime() seconds
+void profileSpan(int track, ProfileZone zone, double begin, double end);
+
+// Main thread, once per frame: close the frame and refresh report when due
+void profileFrame(ProfileReport* report);
+
+// Main thread: record every zone of the next frames frames into per-track
+// buffers, then write them out as trace-<n>.json in the Chrome trace event
+// format (chrome://tracing, Perfetto). Ignored while a capture is running.
+void profileCapture(int frames);
+
+// Scoped timers, compiled out unless the build defines PROFILER
+#ifdef PROFILER
+#define PROFILE_BEGIN(track, zone) profileBegin(track, zone)
+#define PROFILE_END(track, zone) profileEnd(track, zone)
+#define PROFILE_SPAN(track, zone, begin, end) profileSpan(track, zone, begin, end)
+#define PROFILE_FRAME(report) profileFrame(report)
+#define PROFILE_CAPTURE(frames) profileCapture(frames)
+#else
+#define PROFILE_BEGIN(track, zone) ((void)0)
+#define PROFILE_END(track, zone) ((void)0)
+#define PROFILE_SPAN(track, zone, begin, end) ((void)0)
+#define PROFILE_FRAME(report) ((void)0)
+#define PROFILE_CAPTURE(frames) ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
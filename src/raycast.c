@@ -0,0 +1,176 @@
+#include "raycast.h"
+#include "verlet.h"
+
+#include <float.h>
+
+typedef struct {
+    const ParticleStore* store;
+    mfloat_t origin[VEC3_SIZE];
+    mfloat_t direction[VEC3_SIZE];
+    mfloat_t limit;
+    mfloat_t best;
+    int bestIndex;
+} RayState;
+
+// Distance to where the ray enters the sphere, 0 from inside, -1 on a miss
+static mfloat_t intersectSphere(const RayState* ray, const VerletObject* obj)
+{
+    mfloat_t oc[VEC3_SIZE];
+    for (int a = 0; a < 3; a++) {
+        oc[a] = ray->origin[a] - obj->current[a];
+    }
+    mfloat_t b = oc[0] * ray->direction[0] + oc[1] * ray->direction[1] + oc[2] * ray->direction[2];
+    mfloat_t c = oc[0] * oc[0] + oc[1] * oc[1] + oc[2] * oc[2] - obj->radius * obj->radius;
+    if (c > 0 && b > 0) {
+        return -1; // Outside and pointing away
+    }
+    mfloat_t discriminant = b * b - c;
+    if (discriminant < 0) {
+        return -1;
+    }
+    mfloat_t t = -b - MSQRT(discriminant);
+    return t < 0 ? 0 : t;
+}
+
+// Test every particle in the cells lo..hi inclusive
+static void testCells(RayState* ray, const int* lo, const int* hi)
+{
+    int start[3], end[3];
+    for (int a = 0; a < 3; a++) {
+        start[a] = lo[a] < 0 ? 0 : lo[a];
+        end[a] = hi[a] > DIMENSION - 1 ? DIMENSION - 1 : hi[a];
+    }
+    for (int x = start[0]; x <= end[0]; x++) {
+        for (int y = start[1]; y <= end[1]; y++) {
+            for (int z = start[2]; z <= end[2]; z++) {
+                for (Node* node = grid[x][y][z]; node; node = node->next) {
+                    const VerletObject* obj = node->val;
+                    mfloat_t t = intersectSphere(ray, obj);
+                    if (t >= 0 && t < ray->best && t <= ray->limit) {
+                        ray->best = t;
+                        ray->bestIndex = obj - ray->store->objects;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static bool castRay(const ParticleStore* store, const Ray* query, RayHit* hit)
+{
+    RayState ray = { .store = store, .best = FLT_MAX, .bestIndex = -1 };
+    hit->handle = NULL_HANDLE;
+    hit->distance = 0;
+
+    mfloat_t length = MSQRT(query->direction[0] * query->direction[0]
+        + query->direction[1] * query->direction[1] + query->direction[2] * query->direction[2]);
+    if (length <= 0) {
+        return false;
+    }
+    for (int a = 0; a < 3; a++) {
+        ray.origin[a] = query->origin[a];
+        ray.direction[a] = query->direction[a] / length;
+    }
+    ray.limit = query->maxDistance > 0 ? query->maxDistance : FLT_MAX;
+
+    // Clip against the grid's bounds
+    mfloat_t half = DIMENSION / 2 * GRID_CELL;
+    mfloat_t tEnter = 0, tExit = ray.limit;
+    for (int a = 0; a < 3; a++) {
+        if (ray.direction[a] == 0) {
+            if (ray.origin[a] < -half || ray.origin[a] > half) {
+                return false;
+            }
+            continue;
+        }
+        mfloat_t t0 = (-half - ray.origin[a]) / ray.direction[a];
+        mfloat_t t1 = (half - ray.origin[a]) / ray.direction[a];
+        tEnter = MFMAX(tEnter, MFMIN(t0, t1));
+        tExit = MFMIN(tExit, MFMAX(t0, t1));
+    }
+    if (tEnter > tExit) {
+        return false;
+    }
+
+    // 3D-DDA setup from the entry point
+    mfloat_t entry[VEC3_SIZE];
+    int cell[3], step[3];
+    mfloat_t next[3], delta[3];
+    for (int a = 0; a < 3; a++) {
+        entry[a] = ray.origin[a] + ray.direction[a] * tEnter;
+    }
+    gridCoordinates(entry, cell);
+    for (int a = 0; a < 3; a++) {
+        mfloat_t lower = (cell[a] - DIMENSION / 2) * GRID_CELL;
+        if (ray.direction[a] > 0) {
+            step[a] = 1;
+            next[a] = (lower + GRID_CELL - ray.origin[a]) / ray.direction[a];
+            delta[a] = GRID_CELL / ray.direction[a];
+        } else if (ray.direction[a] < 0) {
+            step[a] = -1;
+            next[a] = (lower - ray.origin[a]) / ray.direction[a];
+            delta[a] = -GRID_CELL / ray.direction[a];
+        } else {
+            step[a] = 0;
+            next[a] = FLT_MAX;
+            delta[a] = FLT_MAX;
+        }
+    }
+
+    // A sphere can poke half a cell into its neighbours, so each traversed
+    // cell tests its 3x3x3 block. The first block is tested whole; every step
+    // after that only uncovers one 3x3 slab on the stepping axis.
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] = cell[a] - 1;
+        hi[a] = cell[a] + 1;
+    }
+    testCells(&ray, lo, hi);
+    for (;;) {
+        int a = 0;
+        if (next[1] < next[a]) {
+            a = 1;
+        }
+        if (next[2] < next[a]) {
+            a = 2;
+        }
+        // Every hit still to come is at least this far along the ray
+        mfloat_t t = next[a];
+        if (t > tExit || t > ray.best) {
+            break;
+        }
+        cell[a] += step[a];
+        if (cell[a] < 0 || cell[a] >= DIMENSION) {
+            break;
+        }
+        next[a] += delta[a];
+
+        for (int b = 0; b < 3; b++) {
+            lo[b] = cell[b] - 1;
+            hi[b] = cell[b] + 1;
+        }
+        lo[a] = hi[a] = cell[a] + step[a];
+        testCells(&ray, lo, hi);
+    }
+
+    if (ray.bestIndex < 0) {
+        return false;
+    }
+    hit->handle = handleAtIndex(store, ray.bestIndex);
+    hit->distance = ray.best;
+    for (int a = 0; a < 3; a++) {
+        hit->point[a] = ray.origin[a] + ray.direction[a] * ray.best;
+    }
+    return true;
+}
+
+int castRays(const ParticleStore* store, const Ray* rays, int numRays, RayHit* hits)
+{
+    int numHits = 0;
+    for (int i = 0; i < numRays; i++) {
+        if (castRay(store, &rays[i], &hits[i])) {
+            numHits++;
+        }
+    }
+    return numHits;
+}
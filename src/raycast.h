@@ -0,0 +1,26 @@
+#ifndef __RAYCAST_H__
+#define __RAYCAST_H__
+
+#include "mathc.h"
+#include "particles.h"
+
+typedef struct {
+    mfloat_t origin[VEC3_SIZE];
+    mfloat_t direction[VEC3_SIZE]; // Need not be normalized
+    mfloat_t maxDistance;          // 0 for unbounded
+} Ray;
+
+typedef struct {
+    ParticleHandle handle; // NULL_HANDLE on a miss
+    mfloat_t distance;     // Along the normalized direction
+    mfloat_t point[VEC3_SIZE];
+} RayHit;
+
+// Nearest particle along each ray. Walks the collision grid with a
+// 3D-DDA, so the grid must have been filled from store->objects at their
+// current positions. Only particles in and next to traversed cells are
+// tested, which is exact as long as no radius exceeds half a cell.
+// Returns the number of rays that hit something.
+int castRays(const ParticleStore* store, const Ray* rays, int numRays, RayHit* hits);
+
+#endif
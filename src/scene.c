@@ -0,0 +1,163 @@
+#include "scene.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* speciesNames[] = { "red", "green", "blue", "white" };
+
+static bool parseSpecies(const char* name, int* species)
+{
+    if (strcmp(name, "mixed") == 0) {
+        *species = FILL_MIXED;
+        return true;
+    }
+    for (int s = 0; s < (int)(sizeof(speciesNames) / sizeof(speciesNames[0])); s++) {
+        if (strcmp(name, speciesNames[s]) == 0) {
+            *species = s;
+            return true;
+        }
+    }
+    return false;
+}
+
+#define CANT_READ "can't read"
+#define TEXT(x) #x
+#define NUMBER_TEXT(x) TEXT(x)
+
+// NULL when the line reads, otherwise what is wrong with it
+static const char* parseLine(Scene* scene, const char* line)
+{
+    char kind[16], species[16], shape[16];
+    if (sscanf(line, "%15s", kind) != 1 || kind[0] == '#') {
+        return NULL;
+    }
+    const char* kinds[] = { "fill", "emitter", "field" };
+    int counts[] = { scene->numFills, scene->numEmitters, scene->numFields };
+    for (int k = 0; k < (int)(sizeof(kinds) / sizeof(kinds[0])); k++) {
+        if (strcmp(kind, kinds[k]) == 0 && counts[k] == SCENE_MAX_ITEMS) {
+            return "over the limit of " NUMBER_TEXT(SCENE_MAX_ITEMS) " per kind at";
+        }
+    }
+
+    if (strcmp(kind, "container") == 0) {
+        mfloat_t* c = scene->container;
+        return sscanf(line, "%*s %f %f %f", &c[0], &c[1], &c[2]) == 3 ? NULL : CANT_READ;
+    }
+    if (strcmp(kind, "fill") == 0) {
+        FillVolume* fill = &scene->fills[scene->numFills];
+        int n;
+        if (sscanf(line, "%*s %15s %d %15s %n", species, &fill->count, shape, &n) != 3 || !parseSpecies(species, &fill->species)) {
+            return CANT_READ;
+        }
+        bool ok;
+        if (strcmp(shape, "sphere") == 0) {
+            fill->shape = FILL_SPHERE;
+            ok = sscanf(line + n, "%f %f %f %f", &fill->center[0], &fill->center[1], &fill->center[2], &fill->radius) == 4;
+        } else if (strcmp(shape, "box") == 0) {
+            fill->shape = FILL_BOX;
+            ok = sscanf(line + n, "%f %f %f %f %f %f", &fill->min[0], &fill->min[1], &fill->min[2],
+                     &fill->max[0], &fill->max[1], &fill->max[2]) == 6;
+        } else {
+            ok = false;
+        }
+        scene->numFills += ok;
+        return ok ? NULL : CANT_READ;
+    }
+    if (strcmp(kind, "emitter") == 0) {
+        SceneEmitter* emitter = &scene->emitters[scene->numEmitters];
+        mfloat_t* p = emitter->position;
+        mfloat_t* v = emitter->velocity;
+        if (sscanf(line, "%*s %15s %f %f %f %f %f %f %f %f", species, &p[0], &p[1], &p[2], &v[0], &v[1], &v[2],
+                &emitter->rate, &emitter->lifetime) != 9 || !parseSpecies(species, &emitter->species)) {
+            return CANT_READ;
+        }
+        scene->numEmitters++;
+        return NULL;
+    }
+    if (strcmp(kind, "field") == 0) {
+        SceneField* field = &scene->fields[scene->numFields];
+        mfloat_t* p = field->position;
+        if (sscanf(line, "%*s %f %f %f %f", &p[0], &p[1], &p[2], &field->strength) != 4) {
+            return CANT_READ;
+        }
+        scene->numFields++;
+        return NULL;
+    }
+    return CANT_READ;
+}
+
+Scene* loadScene(const char* path)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("Failed to open scene %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    Scene* scene = malloc(sizeof(Scene));
+    memset(scene, 0, sizeof(Scene));
+
+    char line[256];
+    int number = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        number++;
+        const char* error = parseLine(scene, line);
+        if (error) {
+            printf("%s:%d: %s '%s'\n", path, number, error, strtok(line, "\n"));
+            fclose(fp);
+            free(scene);
+            return NULL;
+        }
+    }
+    fclose(fp);
+    return scene;
+}
+
+void destroyScene(Scene* scene)
+{
+    free(scene);
+}
+
+int applyScene(Scene* scene, ParticleStore* store, mfloat_t* containerPosition, uint32_t seed)
+{
+    vec3_assign(containerPosition, scene->container);
+    int placed = 0;
+    for (int f = 0; f < scene->numFills; f++) {
+        // A different lattice per fill, all following from the one seed
+        placed += fillVolume(store, &scene->fills[f], containerPosition, seed + f * 0x9E3779B9u);
+    }
+    return placed;
+}
+
+void stepScene(Scene* scene, ParticleStore* store, mfloat_t dt, int substeps)
+{
+    static const ParticleColor mixed[] = { RED, GREEN, BLUE };
+    for (int e = 0; e < scene->numEmitters; e++) {
+        SceneEmitter* emitter = &scene->emitters[e];
+        emitter->pending += emitter->rate * dt;
+        int n = (int)emitter->pending;
+        emitter->pending -= n;
+
+        // Verlet velocity is the distance covered per substep
+        mfloat_t velocity[VEC3_SIZE];
+        vec3_multiply_f(velocity, emitter->velocity, dt / substeps);
+        for (int i = 0; i < n; i++) {
+            // Spread over the stretch the step covers instead of stacking them
+            mfloat_t position[VEC3_SIZE];
+            for (int a = 0; a < 3; a++) {
+                position[a] = emitter->position[a] + emitter->velocity[a] * dt * i / n;
+            }
+            ParticleColor color = emitter->species == FILL_MIXED ? mixed[emitter->emitted % 3] : (ParticleColor)emitter->species;
+            if (isHandleValid(store, spawnParticle(store, position, velocity, color, VERLET_RADIUS, emitter->lifetime))) {
+                emitter->emitted++;
+            }
+        }
+    }
+
+    // SIM_FORCE acts on the first substep only, so it is scaled up to match
+    // an acceleration held through the whole step
+    for (int f = 0; f < scene->numFields; f++) {
+        addForce(store->objects, store->count, scene->fields[f].position, scene->fields[f].strength * substeps);
+    }
+}
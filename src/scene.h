@@ -0,0 +1,54 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <stdint.h>
+
+#include "emitter.h"
+
+#define SCENE_MAX_ITEMS 32 // Per kind of entry
+
+// Particles streamed in at a steady rate while the simulation runs
+typedef struct {
+    mfloat_t position[VEC3_SIZE];
+    mfloat_t velocity[VEC3_SIZE]; // Units per second
+    int species;                  // ParticleColor or FILL_MIXED
+    mfloat_t rate;                // Particles per second
+    mfloat_t lifetime;            // Seconds, 0 for immortal
+    mfloat_t pending;             // Fraction of a particle carried to the next step
+    int emitted;
+} SceneEmitter;
+
+// Point force acting every step, like holding G at that point
+typedef struct {
+    mfloat_t position[VEC3_SIZE];
+    mfloat_t strength; // Acceleration away from the point; negative attracts
+} SceneField;
+
+// Initial conditions read from a text file, one entry per line:
+//   container X Y Z
+//   fill SPECIES COUNT sphere X Y Z RADIUS
+//   fill SPECIES COUNT box X0 Y0 Z0 X1 Y1 Z1
+//   emitter SPECIES X Y Z VX VY VZ RATE LIFETIME
+//   field X Y Z STRENGTH
+// SPECIES is red, green, blue, white or mixed; '#' starts a comment.
+typedef struct {
+    mfloat_t container[VEC3_SIZE];
+    FillVolume fills[SCENE_MAX_ITEMS];
+    int numFills;
+    SceneEmitter emitters[SCENE_MAX_ITEMS];
+    int numEmitters;
+    SceneField fields[SCENE_MAX_ITEMS];
+    int numFields;
+} Scene;
+
+// NULL if the file can't be read or has a bad line
+Scene* loadScene(const char* path);
+void destroyScene(Scene* scene);
+
+// Move the container and run the fills into store. Returns particles placed.
+int applyScene(Scene* scene, ParticleStore* store, mfloat_t* containerPosition, uint32_t seed);
+
+// Run the emitters and fields for one step of dt seconds
+void stepScene(Scene* scene, ParticleStore* store, mfloat_t dt, int substeps);
+
+#endif
@@ -0,0 +1,71 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, clock_nanosleep
+
+#include "scheduler.h"
+
+#include <time.h>
+
+double monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleepUntil(double deadline)
+{
+    // The kernel wakes us up late by up to a scheduler tick, so stop short
+    double coarse = deadline - SCHEDULER_SPIN;
+    if (coarse > monotonicTime()) {
+        struct timespec ts;
+        ts.tv_sec = (time_t)coarse;
+        ts.tv_nsec = (long)((coarse - ts.tv_sec) * 1e9);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+            // Interrupted by a signal, sleep the rest
+        }
+    }
+    while (monotonicTime() < deadline) {
+        // Spin the last stretch
+    }
+}
+
+void initScheduler(FrameScheduler* scheduler, double period, double maxLag)
+{
+    scheduler->period = period;
+    scheduler->maxLag = maxLag;
+    scheduler->last = monotonicTime();
+    scheduler->next = scheduler->last + period;
+    scheduler->dropped = 0;
+    scheduler->jitterSum = 0.0;
+    scheduler->jitterMax = 0.0;
+    scheduler->samples = 0;
+    scheduler->jitterMs = 0.0f;
+    scheduler->maxJitterMs = 0.0f;
+}
+
+double waitNextFrame(FrameScheduler* scheduler)
+{
+    if (monotonicTime() - scheduler->next > scheduler->maxLag) {
+        scheduler->next = monotonicTime();
+        scheduler->dropped++;
+    }
+    sleepUntil(scheduler->next);
+
+    double now = monotonicTime();
+    double late = now - scheduler->next;
+    scheduler->jitterSum += late;
+    if (late > scheduler->jitterMax) {
+        scheduler->jitterMax = late;
+    }
+    if (++scheduler->samples == SCHEDULER_WINDOW) {
+        scheduler->jitterMs = scheduler->jitterSum / scheduler->samples * 1000.0;
+        scheduler->maxJitterMs = scheduler->jitterMax * 1000.0;
+        scheduler->jitterSum = 0.0;
+        scheduler->jitterMax = 0.0;
+        scheduler->samples = 0;
+    }
+
+    scheduler->next += scheduler->period;
+    double elapsed = now - scheduler->last;
+    scheduler->last = now;
+    return elapsed;
+}
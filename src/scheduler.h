@@ -0,0 +1,35 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#define SCHEDULER_SPIN 0.0005     // Seconds before a deadline spent spinning instead of sleeping
+#define SCHEDULER_WINDOW 120      // Frames per jitter report
+
+// Fixed-period deadline pacing. Late frames are caught up on by running the
+// next ones back to back, until the backlog exceeds maxLag and is dropped.
+typedef struct {
+    double period;
+    double maxLag;
+    double next; // Deadline of the upcoming frame
+    double last; // When the previous wait returned
+    unsigned long dropped;
+
+    // Wake-up lateness over the current window
+    double jitterSum;
+    double jitterMax;
+    int samples;
+
+    // Last completed window, in milliseconds
+    float jitterMs;
+    float maxJitterMs;
+} FrameScheduler;
+
+// Monotonic seconds in double precision
+double monotonicTime();
+
+void initScheduler(FrameScheduler* scheduler, double period, double maxLag);
+
+// Sleep until the next deadline, coarsely with nanosleep and then spinning
+// for the last SCHEDULER_SPIN. Returns the seconds since the previous call.
+double waitNextFrame(FrameScheduler* scheduler);
+
+#endif
@@ -1,50 +1,173 @@
+#define _POSIX_C_SOURCE 200809L // mkdir, fileno, getpid
+
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "shader.h"
 #include "util.h"
 
 //#include "dependencies/include/GL/glew.h"
 #include <GL/glew.h>
 
-unsigned int createShader(const char* vertexFile, const char* fragmentFile)
+static const char* uniformNames[UNIFORM_COUNT] = {
+    [UNIFORM_MODEL] = "model",
+};
+
+#define CACHE_MAGIC 0x31424750 // "PGB1"
+
+// Header in front of every cached program binary
+typedef struct {
+    uint32_t magic;
+    uint32_t format;
+    uint32_t length;
+} CacheHeader;
+
+// Program currently bound through useShader, so repeated binds are skipped
+static unsigned int boundProgram = 0;
+
+static int cacheHits = 0;
+static int cacheCompiles = 0;
+
+// FNV-1a, chained over several strings
+static uint64_t hashString(uint64_t hash, const char* text)
+{
+    for (const unsigned char* c = (const unsigned char*)(text ? text : ""); *c; c++) {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    // Separator so "ab" + "c" and "a" + "bc" differ
+    hash ^= 0xff;
+    hash *= 0x100000001b3ULL;
+    return hash;
+}
+
+static bool cacheSupported()
+{
+    if (!GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+// Binaries only load on the driver that produced them, so it is part of the key
+static void cachePath(char* path, size_t size, const char* vertexSource, const char* fragmentSource, const char* defines)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    hash = hashString(hash, vertexSource);
+    hash = hashString(hash, fragmentSource);
+    hash = hashString(hash, defines);
+    hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+    hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+    hash = hashString(hash, (const char*)glGetString(GL_VERSION));
+    snprintf(path, size, "%s/%016llx.bin", SHADER_CACHE_DIR, (unsigned long long)hash);
+}
+
+// Returns a linked program, or 0 when there is no usable binary
+static unsigned int loadCachedProgram(const char* path)
+{
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    CacheHeader header;
+    unsigned int program = 0;
+    struct stat info;
+    // The binary is the rest of the file, whatever length the header claims
+    if (fstat(fileno(fp), &info) == 0 && fread(&header, sizeof(header), 1, fp) == 1 && header.magic == CACHE_MAGIC
+        && header.length > 0 && (uint64_t)info.st_size == sizeof(header) + (uint64_t)header.length) {
+        void* binary = malloc(header.length);
+        if (fread(binary, 1, header.length, fp) == header.length) {
+            program = glCreateProgram();
+            glProgramBinary(program, header.format, binary, header.length);
+            GLint success = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &success);
+            if (success == GL_FALSE) {
+                // Driver update or foreign binary, rebuild from source
+                glDeleteProgram(program);
+                program = 0;
+            }
+        }
+        free(binary);
+    }
+    fclose(fp);
+    return program;
+}
+
+static void saveCachedProgram(unsigned int program, const char* path)
 {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    void* binary = malloc(length);
+    GLenum format;
+    glGetProgramBinary(program, length, NULL, &format, binary);
 
+    // Written under a name of this process's own and renamed into place, so a
+    // cut-short write or a second run writing the same program is never read back
+    char temporary[288];
+    snprintf(temporary, sizeof(temporary), "%s.%d.tmp", path, (int)getpid());
+    mkdir(SHADER_CACHE_DIR, 0755);
+    FILE* fp = fopen(temporary, "wb");
+    if (fp != NULL) {
+        CacheHeader header = { CACHE_MAGIC, format, (uint32_t)length };
+        bool written = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(binary, 1, length, fp) == (size_t)length;
+        if (fclose(fp) == 0 && written) {
+            rename(temporary, path);
+        } else {
+            remove(temporary);
+        }
+    }
+    free(binary);
+}
+
+static unsigned int compileStage(GLenum type, const char* filename, char* source, const char* defines)
+{
     GLint success = 0;
     GLint logSize = 0;
 
-    // Create a shader object and compile it during runtime
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    const char* vertexShaderSource = readFile(vertexFile);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (success == GL_FALSE) {
-        glGetShaderiv(vertexShader, GL_INFO_LOG_LENGTH, &logSize);
-        GLchar infoLog[logSize];
-        glGetShaderInfoLog(vertexShader, logSize, &logSize, infoLog);
-        glDeleteShader(vertexShader);
-        printf("Vertex Shader: %s\n", infoLog);
+    // Split after the #version line, which has to stay first
+    char* body = source;
+    if (strncmp(source, "#version", 8) == 0) {
+        char* newline = strchr(source, '\n');
+        body = newline ? newline + 1 : source + strlen(source);
     }
+    const char* sources[3] = { source, defines ? defines : "", body };
+    GLint lengths[3] = { (GLint)(body - source), -1, -1 };
 
-    // Perform the same steps for the fragment shader
-    unsigned int fragmentShader;
-    fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    const char* fragmentShaderSource = readFile(fragmentFile);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
+    // Create a shader object and compile it during runtime
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 3, sources, lengths);
+    glCompileShader(shader);
 
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (success == GL_FALSE) {
-        glGetShaderiv(fragmentShader, GL_INFO_LOG_LENGTH, &logSize);
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logSize);
         GLchar infoLog[logSize];
-        glGetShaderInfoLog(fragmentShader, logSize, &logSize, infoLog);
-        glDeleteShader(fragmentShader);
-        printf("Fragment Shader: %s\n", infoLog);
+        glGetShaderInfoLog(shader, logSize, &logSize, infoLog);
+        printf("%s: %s\n", filename, infoLog);
     }
+    return shader;
+}
+
+static unsigned int linkProgram(const char* vertexFile, char* vertexSource,
+    const char* fragmentFile, char* fragmentSource, const char* defines, bool retrievable)
+{
+    unsigned int vertexShader = compileStage(GL_VERTEX_SHADER, vertexFile, vertexSource, defines);
+    unsigned int fragmentShader = compileStage(GL_FRAGMENT_SHADER, fragmentFile, fragmentSource, defines);
 
     // Create a shader program and link the two shader steps together
     unsigned int shaderProgram = glCreateProgram();
+    if (retrievable) {
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glAttachShader(shaderProgram, vertexShader);
     glAttachShader(shaderProgram, fragmentShader);
     glLinkProgram(shaderProgram);
@@ -53,16 +176,86 @@ unsigned int createShader(const char* vertexFile, const char* fragmentFile)
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 
-    // Return the program
+    GLint success = 0;
+    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+    if (success == GL_FALSE) {
+        GLint logSize = 0;
+        glGetProgramiv(shaderProgram, GL_INFO_LOG_LENGTH, &logSize);
+        GLchar infoLog[logSize];
+        glGetProgramInfoLog(shaderProgram, logSize, &logSize, infoLog);
+        printf("Program %s + %s: %s\n", vertexFile, fragmentFile, infoLog);
+    }
     return shaderProgram;
 }
 
+ShaderProgram* createShader(const char* vertexFile, const char* fragmentFile, const char* defines)
+{
+    char* vertexSource = readFile(vertexFile);
+    char* fragmentSource = readFile(fragmentFile);
+
+    // Try the binary cache first, compiling from source only on a miss
+    bool cache = cacheSupported();
+    char path[256];
+    unsigned int shaderProgram = 0;
+    if (cache) {
+        cachePath(path, sizeof(path), vertexSource, fragmentSource, defines);
+        shaderProgram = loadCachedProgram(path);
+    }
+    if (shaderProgram) {
+        cacheHits++;
+    } else {
+        shaderProgram = linkProgram(vertexFile, vertexSource, fragmentFile, fragmentSource, defines, cache);
+        cacheCompiles++;
+        GLint success = GL_FALSE;
+        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+        if (cache && success == GL_TRUE) {
+            saveCachedProgram(shaderProgram, path);
+        }
+    }
+    free(vertexSource);
+    free(fragmentSource);
+
+    ShaderProgram* shader = malloc(sizeof(ShaderProgram));
+    shader->ID = shaderProgram;
+    for (int u = 0; u < UNIFORM_COUNT; u++) {
+        shader->uniforms[u] = glGetUniformLocation(shaderProgram, uniformNames[u]);
+    }
+
+    // Every program reads view/projection from the same uniform buffer. Block
+    // bindings are not part of a program binary, so this runs on both paths
+    unsigned int cameraBlock = glGetUniformBlockIndex(shaderProgram, "Camera");
+    if (cameraBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shaderProgram, cameraBlock, CAMERA_BINDING);
+    }
+
+    return shader;
+}
+
+void useShader(const ShaderProgram* shader)
+{
+    if (shader->ID != boundProgram) {
+        glUseProgram(shader->ID);
+        boundProgram = shader->ID;
+    }
+}
+
 void detachShader()
 {
     glUseProgram(0);
+    boundProgram = 0;
 }
 
-void destroyShader(unsigned int shaderID)
+void destroyShader(ShaderProgram* shader)
 {
-    glDeleteProgram(shaderID);
-}
\ No newline at end of file
+    if (shader->ID == boundProgram) {
+        detachShader();
+    }
+    glDeleteProgram(shader->ID);
+    free(shader);
+}
+
+void getShaderCacheStats(int* hits, int* compiles)
+{
+    *hits = cacheHits;
+    *compiles = cacheCompiles;
+}
@@ -1,10 +1,33 @@
 #ifndef __SHADER_H__
 #define __SHADER_H__
 
-unsigned int createShader(const char* vertexFile, const char* fragmentFile);
+#define CAMERA_BINDING 0 // Uniform buffer binding point of the shared Camera block
+#define SHADER_CACHE_DIR "shadercache" // Linked program binaries, keyed by source and driver
+
+// Per-program uniforms, looked up once when the program is linked
+enum {
+    UNIFORM_MODEL,
+    UNIFORM_COUNT
+};
+
+typedef struct {
+    unsigned int ID;
+    int uniforms[UNIFORM_COUNT]; // -1 when the program does not use it
+} ShaderProgram;
+
+// defines (may be NULL) is inserted right after the #version line of both
+// stages, so variants like "#define INSTANCED\n" share one pair of files.
+// A cached binary from an earlier run is used when the driver accepts it.
+ShaderProgram* createShader(const char* vertexFile, const char* fragmentFile, const char* defines);
+
+// Binds the program unless it already is
+void useShader(const ShaderProgram* shader);
 
 void detachShader();
 
-void destroyShader(unsigned int shaderID);
+void destroyShader(ShaderProgram* shader);
+
+// Programs loaded from the binary cache vs. compiled from source so far
+void getShaderCacheStats(int* hits, int* compiles);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,303 @@
+#include "simulation.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "inputlog.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+const char* simPhaseNames[SIM_PHASES] = { "forces", "grid", "collisions", "constraints", "integration" };
+
+// Seconds since mark, moving mark to now; the span also goes to the profiler
+static double lap(double* mark, ProfileZone zone)
+{
+    double now = monotonicTime();
+    double elapsed = now - *mark;
+    PROFILE_SPAN(PROFILE_SIM, zone, *mark, now);
+    *mark = now;
+    return elapsed;
+}
+
+Simulation* createSimulation(int capacity)
+{
+    Simulation* sim = malloc(sizeof(Simulation));
+    memset(sim, 0, sizeof(Simulation));
+    pthread_mutex_init(&sim->lock, NULL);
+    sim->store = createParticleStore(capacity);
+    for (int s = 0; s < SIM_SNAPSHOTS; s++) {
+        sim->snapshots[s].objects = malloc(sizeof(VerletObject) * capacity);
+        sim->snapshots[s].origins = malloc(sizeof(mfloat_t) * VEC3_SIZE * capacity);
+    }
+    sim->latest = 0;
+    sim->reading = 0;
+    sim->writing = 1;
+    return sim;
+}
+
+static void applyCommands(Simulation* sim, int count, bool* clear)
+{
+    ParticleStore* store = sim->store;
+    for (int c = 0; c < count; c++) {
+        SimCommand* command = &sim->batch[c];
+        switch (command->type) {
+        case SIM_INSERT:
+            insertParticle(store, &command->object);
+            break;
+        case SIM_SPAWN:
+            spawnParticle(store, command->position, command->velocity, command->color, command->radius, command->lifetime);
+            break;
+        case SIM_FORCE:
+            addForce(store->objects, store->count, command->position, command->strength);
+            break;
+        case SIM_ATTRACT:
+            vec3_assign(sim->attractor, command->position);
+            sim->attractorStrength = command->strength;
+            break;
+        case SIM_CLEAR:
+            *clear = true;
+            break;
+        case SIM_DRAIN: {
+            ParticleSink drain = { { sim->containerPosition[0], sim->containerPosition[1] - CONTAINER_RADIUS, sim->containerPosition[2] }, command->radius };
+            applySinks(store, &drain, 1);
+            break;
+        }
+        case SIM_MOVE_CONTAINER:
+            vec3_add(sim->containerPosition, sim->containerPosition, command->position);
+            break;
+        case SIM_PICK: {
+            Ray* ray = &sim->rays[sim->numRays++];
+            vec3_assign(ray->origin, command->position);
+            vec3_assign(ray->direction, command->velocity);
+            ray->maxDistance = command->radius;
+            break;
+        }
+        case SIM_DRAG: {
+            VerletObject* obj = getParticle(store, command->handle);
+            if (obj) {
+                vec3_assign(obj->current, command->position);
+                vec3_assign(obj->previous, command->position);
+            }
+            break;
+        }
+        case SIM_SAVE:
+            if (saveSnapshot(command->path, store, sim->containerPosition, sim->step)) {
+                printf("Saved %d particles to %s\n", store->count, command->path);
+            }
+            break;
+        case SIM_LOAD: {
+            double start = monotonicTime();
+            if (loadSnapshot(command->path, store, sim->containerPosition, NULL)) {
+                printf("Restored %d particles from %s in %.2f ms\n", store->count, command->path, (monotonicTime() - start) * 1000.0);
+            }
+            break;
+        }
+        }
+    }
+}
+
+static void stepSimulation(Simulation* sim)
+{
+    double start = monotonicTime();
+
+    // A replay supplies the step's commands; live input is dropped meanwhile,
+    // except for what leaves the state alone
+    int count = 0;
+    bool replaying = sim->replay && !sim->replay->finished;
+    if (replaying) {
+        count = replayStep(sim->replay, sim->step + 1, sim->batch, SIM_QUEUE_SIZE);
+        if (count < 0) {
+            printf("Replay finished after step %lu, live input resumes\n", sim->step);
+            replaying = false;
+            count = 0;
+        }
+    }
+
+    // Take everything queued since the last step
+    pthread_mutex_lock(&sim->lock);
+    for (int c = 0; c < sim->queueCount && count < SIM_QUEUE_SIZE; c++) {
+        SimCommandType type = sim->queue[c].type;
+        if (!replaying || type == SIM_PICK || type == SIM_SAVE) {
+            sim->batch[count++] = sim->queue[c];
+        }
+    }
+    sim->queueCount = 0;
+    pthread_mutex_unlock(&sim->lock);
+
+    bool clear = false;
+    sim->numRays = 0;
+    applyCommands(sim, count, &clear);
+    if (sim->scene) {
+        stepScene(sim->scene, sim->store, SIM_STEP, SIM_SUBSTEPS);
+    }
+    if (sim->attractorStrength != 0.0f) {
+        addForce(sim->store->objects, sim->store->count, sim->attractor, sim->attractorStrength);
+    }
+    despawnExpired(sim->store, SIM_STEP);
+
+    VerletObject* verlets = sim->store->objects;
+    int numActive = sim->store->count;
+    SimSnapshot* snapshot = &sim->snapshots[sim->writing];
+    for (int i = 0; i < numActive; i++) {
+        vec3_assign(&snapshot->origins[i * VEC3_SIZE], verlets[i].current);
+    }
+
+    double phase[SIM_PHASES] = { 0 };
+    float sub_dt = SIM_STEP / SIM_SUBSTEPS;
+    for (int i = 0; i < SIM_SUBSTEPS; i++) {
+        double mark = monotonicTime();
+        applyForces(verlets, numActive);
+        if (clear) {
+            for (int j = 0; j < numActive; ++j) {
+                vec3_zero(verlets[j].acceleration);
+            }
+        }
+        phase[SIM_PHASE_FORCES] += lap(&mark, PROFILE_FORCES);
+        clearGrid();
+        fillGrid(verlets, numActive);
+        phase[SIM_PHASE_GRID] += lap(&mark, PROFILE_GRID);
+        resolveGridCollisions();
+        phase[SIM_PHASE_COLLISIONS] += lap(&mark, PROFILE_COLLISIONS);
+        applyConstraints(verlets, numActive, sim->containerPosition);
+        phase[SIM_PHASE_CONSTRAINTS] += lap(&mark, PROFILE_CONSTRAINTS);
+        // If clearing, also zero velocity by making previous == current before integration
+        if (clear) {
+            for (int j = 0; j < numActive; ++j) {
+                vec3_assign(verlets[j].previous, verlets[j].current);
+            }
+        }
+        updatePositions(verlets, numActive, sub_dt);
+        phase[SIM_PHASE_INTEGRATION] += lap(&mark, PROFILE_INTEGRATION);
+    }
+    for (int p = 0; p < SIM_PHASES; p++) {
+        snapshot->phaseMs[p] = phase[p] * 1000.0;
+    }
+
+    if (sim->numRays > 0) {
+        // The grid still holds the last substep's positions
+        clearGrid();
+        fillGrid(verlets, numActive);
+        castRays(sim->store, sim->rays, sim->numRays, sim->results);
+    }
+
+    memcpy(snapshot->objects, verlets, sizeof(VerletObject) * numActive);
+    snapshot->count = numActive;
+    vec3_assign(snapshot->containerPosition, sim->containerPosition);
+    snapshot->step = ++sim->step;
+    if (sim->inputLog) {
+        logStep(sim->inputLog, sim->step, sim->batch, count, sim->store);
+    }
+    if (replaying) {
+        checkReplay(sim->replay, sim->step, sim->store);
+    }
+    if (sim->recorder) {
+        recordTrajectory(sim->recorder, sim->store, sim->containerPosition, sim->step);
+    }
+    if (sim->exporter) {
+        exportStep(sim->exporter, sim->store, sim->step);
+    }
+    snapshot->stepMs = (monotonicTime() - start) * 1000.0;
+
+    // Publish, then write the next step into whichever buffer nobody holds
+    pthread_mutex_lock(&sim->lock);
+    int numResults = sim->numRays;
+    if (numResults > SIM_QUEUE_SIZE - sim->numHits) {
+        numResults = SIM_QUEUE_SIZE - sim->numHits; // Nobody is taking them
+    }
+    memcpy(&sim->hits[sim->numHits], sim->results, sizeof(RayHit) * numResults);
+    sim->numHits += numResults;
+    snapshot->published = monotonicTime();
+    sim->latest = sim->writing;
+    for (int s = 0; s < SIM_SNAPSHOTS; s++) {
+        if (s != sim->latest && s != sim->reading) {
+            sim->writing = s;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim->lock);
+}
+
+static void* simulationLoop(void* arg)
+{
+    Simulation* sim = arg;
+    FrameScheduler scheduler;
+    initScheduler(&scheduler, SIM_STEP, SIM_MAX_LAG);
+    for (;;) {
+        pthread_mutex_lock(&sim->lock);
+        bool running = sim->running;
+        pthread_mutex_unlock(&sim->lock);
+        if (!running) {
+            break;
+        }
+
+        stepSimulation(sim);
+        // Too slow for real time drops the backlog instead of spiralling
+        waitNextFrame(&scheduler);
+    }
+    return NULL;
+}
+
+void advanceSimulation(Simulation* sim)
+{
+    stepSimulation(sim);
+}
+
+void startSimulation(Simulation* sim)
+{
+    sim->running = true;
+    pthread_create(&sim->thread, NULL, simulationLoop, sim);
+}
+
+void destroySimulation(Simulation* sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    bool running = sim->running;
+    sim->running = false;
+    pthread_mutex_unlock(&sim->lock);
+    if (running) {
+        pthread_join(sim->thread, NULL);
+    }
+
+    for (int s = 0; s < SIM_SNAPSHOTS; s++) {
+        free(sim->snapshots[s].objects);
+        free(sim->snapshots[s].origins);
+    }
+    destroyParticleStore(sim->store);
+    pthread_mutex_destroy(&sim->lock);
+    free(sim);
+}
+
+bool pushCommand(Simulation* sim, const SimCommand* command)
+{
+    pthread_mutex_lock(&sim->lock);
+    bool queued = sim->queueCount < SIM_QUEUE_SIZE;
+    if (queued) {
+        sim->queue[sim->queueCount++] = *command;
+    }
+    pthread_mutex_unlock(&sim->lock);
+    return queued;
+}
+
+const SimSnapshot* acquireSnapshot(Simulation* sim, mfloat_t* alpha)
+{
+    pthread_mutex_lock(&sim->lock);
+    sim->reading = sim->latest;
+    const SimSnapshot* snapshot = &sim->snapshots[sim->reading];
+    pthread_mutex_unlock(&sim->lock);
+
+    mfloat_t t = (monotonicTime() - snapshot->published) / SIM_STEP;
+    *alpha = clampf(t, 0.0f, 1.0f);
+    return snapshot;
+}
+
+int takeRayHits(Simulation* sim, RayHit* hits, int max)
+{
+    pthread_mutex_lock(&sim->lock);
+    int count = sim->numHits < max ? sim->numHits : max;
+    memcpy(hits, sim->hits, sizeof(RayHit) * count);
+    memmove(sim->hits, &sim->hits[count], sizeof(RayHit) * (sim->numHits - count));
+    sim->numHits -= count;
+    pthread_mutex_unlock(&sim->lock);
+    return count;
+}
@@ -0,0 +1,131 @@
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "mathc.h"
+#include "verlet.h"
+#include "particles.h"
+#include "raycast.h"
+#include "trajectory.h"
+#include "export.h"
+#include "scene.h"
+
+#define SIM_STEP (1.0 / 60.0) // Simulated seconds per step
+#define SIM_SUBSTEPS 8
+#define SIM_MAX_LAG 0.25      // Seconds behind schedule before the sim stops catching up
+#define SIM_QUEUE_SIZE 1024
+#define SIM_SNAPSHOTS 3       // Latest, being read by the renderer, being written
+
+typedef enum {
+    SIM_INSERT,         // object
+    SIM_SPAWN,          // position, velocity, color, radius, lifetime
+    SIM_FORCE,          // position (origin), strength
+    SIM_CLEAR,          // Zero accelerations and velocities for one step
+    SIM_DRAIN,          // radius; sink at the bottom of the container
+    SIM_MOVE_CONTAINER, // position (offset)
+    SIM_PICK,           // position (origin), velocity (direction), radius (max distance, 0 for none)
+    SIM_DRAG,           // handle, position (target); the particle is held there at rest
+    SIM_SAVE,           // path
+    SIM_LOAD,           // path; replaces every particle and the container position
+    SIM_ATTRACT,        // position (origin), strength; held every step until one with strength 0
+} SimCommandType;
+
+// Change requested by the render thread, applied at the start of the next step
+typedef struct {
+    SimCommandType type;
+    VerletObject object;
+    ParticleHandle handle;
+    mfloat_t position[VEC3_SIZE];
+    mfloat_t velocity[VEC3_SIZE];
+    ParticleColor color;
+    mfloat_t radius;
+    mfloat_t lifetime;
+    mfloat_t strength;
+    const char* path; // Must outlive the step that takes the command
+} SimCommand;
+
+// Parts of a step timed for the HUD and the benchmarks, summed over the substeps
+typedef enum {
+    SIM_PHASE_FORCES,
+    SIM_PHASE_GRID,        // clearGrid and fillGrid
+    SIM_PHASE_COLLISIONS,
+    SIM_PHASE_CONSTRAINTS,
+    SIM_PHASE_INTEGRATION,
+    SIM_PHASES
+} SimPhase;
+
+extern const char* simPhaseNames[SIM_PHASES];
+
+// State after one step. origins holds every particle's position at the start
+// of that step, index-aligned with objects, so the renderer can interpolate
+// across the step without following particles through swap-removes.
+typedef struct {
+    VerletObject* objects;
+    mfloat_t* origins; // VEC3_SIZE per object
+    int count;
+    mfloat_t containerPosition[VEC3_SIZE];
+    double published;  // monotonicTime() when the snapshot became the latest
+    float stepMs;
+    float phaseMs[SIM_PHASES];
+    unsigned long step;
+} SimSnapshot;
+
+// Fixed-timestep simulation on its own thread. The particle store is only
+// touched by that thread; everyone else talks to it through commands and
+// reads the published snapshots.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock; // Guards the queue, the snapshot indices and running
+    bool running;
+
+    ParticleStore* store;
+    mfloat_t containerPosition[VEC3_SIZE];
+    unsigned long step;
+    TrajectoryRecorder* recorder; // Every step is recorded when set; owned by the caller
+    Exporter* exporter;           // Gets every step when set; owned by the caller
+    struct InputLog* inputLog;    // Every step's commands are logged when set; owned by the caller
+    struct InputLog* replay;      // Commands come from this log instead of the queue until it ends
+    Scene* scene;                 // Emitters and fields run every step when set; owned by the caller
+    mfloat_t attractor[VEC3_SIZE]; // Held SIM_ATTRACT, applied once a step
+    mfloat_t attractorStrength;    // 0 when released
+
+    SimCommand queue[SIM_QUEUE_SIZE];
+    int queueCount;
+    SimCommand batch[SIM_QUEUE_SIZE]; // Commands taken by the current step
+
+    // SIM_PICK rays are cast at the end of the step against its final
+    // positions; results wait here, in queue order, until taken
+    Ray rays[SIM_QUEUE_SIZE];
+    int numRays;
+    RayHit results[SIM_QUEUE_SIZE];
+    RayHit hits[SIM_QUEUE_SIZE];
+    int numHits;
+
+    SimSnapshot snapshots[SIM_SNAPSHOTS];
+    int latest;
+    int reading;
+    int writing;
+} Simulation;
+
+Simulation* createSimulation(int capacity);
+void startSimulation(Simulation* sim);
+// Stops and joins the thread if it is running
+void destroySimulation(Simulation* sim);
+
+// Run one step on the calling thread, for offline use without startSimulation
+void advanceSimulation(Simulation* sim);
+
+// Returns false when the queue is full and the command was dropped
+bool pushCommand(Simulation* sim, const SimCommand* command);
+
+// Move up to max finished SIM_PICK results into hits, oldest first; misses
+// have a NULL_HANDLE. Returns how many were taken.
+int takeRayHits(Simulation* sim, RayHit* hits, int max);
+
+// Latest snapshot, held until the next call. alpha in [0, 1] is how far the
+// display time has progressed from its origins to its objects.
+const SimSnapshot* acquireSnapshot(Simulation* sim, mfloat_t* alpha);
+
+#endif
@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L // writev, mmap, posix_madvise
+
+#include "snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static uint64_t alignUp(uint64_t offset)
+{
+    return (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+}
+
+// The rename only lasts once the directory entry is on disk too
+static bool syncDirectory(const char* path)
+{
+    char directory[1024];
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL) {
+        snprintf(directory, sizeof(directory), ".");
+    } else {
+        snprintf(directory, sizeof(directory), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    }
+    int fd = open(directory, O_RDONLY);
+    if (fd < 0 || fsync(fd) != 0) {
+        printf("Failed to sync directory %s: %s\n", directory, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+bool saveSnapshot(const char* path, const ParticleStore* store, const mfloat_t* containerPosition, unsigned long step)
+{
+    static const char padding[SNAPSHOT_ALIGN] = { 0 };
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.objectSize = sizeof(VerletObject);
+    header.count = store->count;
+    header.numSlots = store->numSlots;
+    header.numFree = store->numFree;
+    header.numSpecies = SNAPSHOT_SPECIES;
+    header.step = step;
+    vec3_assign(header.containerPosition, (mfloat_t*)containerPosition);
+    header.containerRadius = CONTAINER_RADIUS;
+    for (int s = 0; s < SNAPSHOT_SPECIES; s++) {
+        VerletObject probe = { .color = s };
+        setColorVector(&probe);
+        setMassFromColor(&probe);
+        vec3_assign(header.species[s].color, probe.colorVector);
+        header.species[s].mass = probe.mass;
+    }
+
+    const void* streams[SNAPSHOT_STREAMS] = { store->objects, store->owners, store->dense, store->generations, store->freeSlots };
+    header.sizes[STREAM_OBJECTS] = sizeof(VerletObject) * store->count;
+    header.sizes[STREAM_OWNERS] = sizeof(uint32_t) * store->count;
+    header.sizes[STREAM_DENSE] = sizeof(uint32_t) * store->numSlots;
+    header.sizes[STREAM_GENERATIONS] = sizeof(uint32_t) * store->numSlots;
+    header.sizes[STREAM_FREE_SLOTS] = sizeof(uint32_t) * store->numFree;
+
+    // Header, then each stream behind the padding that aligns it
+    struct iovec iov[1 + 2 * SNAPSHOT_STREAMS];
+    int numIov = 0;
+    iov[numIov++] = (struct iovec) { &header, sizeof(header) };
+    uint64_t offset = sizeof(header);
+    for (int s = 0; s < SNAPSHOT_STREAMS; s++) {
+        uint64_t aligned = alignUp(offset);
+        if (aligned > offset) {
+            iov[numIov++] = (struct iovec) { (void*)padding, aligned - offset };
+        }
+        header.offsets[s] = aligned;
+        iov[numIov++] = (struct iovec) { (void*)streams[s], header.sizes[s] };
+        offset = aligned + header.sizes[s];
+    }
+
+    char temporary[1024];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("Failed to create snapshot %s: %s\n", temporary, strerror(errno));
+        return false;
+    }
+
+    // One call normally; large files may come back short and need the rest
+    struct iovec* next = iov;
+    while (numIov > 0) {
+        ssize_t written = writev(fd, next, numIov);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Failed to write snapshot %s: %s\n", temporary, strerror(errno));
+            close(fd);
+            unlink(temporary);
+            return false;
+        }
+        while (numIov > 0 && (size_t)written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            numIov--;
+        }
+        if (numIov > 0) {
+            next->iov_base = (char*)next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+    // The data has to be on disk before the rename can point at it
+    if (fsync(fd) != 0) {
+        printf("Failed to sync snapshot %s: %s\n", temporary, strerror(errno));
+        close(fd);
+        unlink(temporary);
+        return false;
+    }
+    close(fd);
+
+    if (rename(temporary, path) != 0) {
+        printf("Failed to replace snapshot %s: %s\n", path, strerror(errno));
+        unlink(temporary);
+        return false;
+    }
+    return syncDirectory(path);
+}
+
+static bool validateHeader(const SnapshotHeader* header, size_t fileSize, const ParticleStore* store)
+{
+    if (header->magic != SNAPSHOT_MAGIC) {
+        printf("Not a snapshot\n");
+        return false;
+    }
+    if (header->version != SNAPSHOT_VERSION || header->headerSize != sizeof(SnapshotHeader)
+        || header->objectSize != sizeof(VerletObject)) {
+        printf("Snapshot version %u does not match this build\n", header->version);
+        return false;
+    }
+    if (header->count > header->numSlots || header->numFree > header->numSlots
+        || header->numSlots > (uint32_t)store->capacity) {
+        printf("Snapshot holds %u particles in %u slots, the store has room for %d\n",
+            header->count, header->numSlots, store->capacity);
+        return false;
+    }
+
+    uint64_t expected[SNAPSHOT_STREAMS] = {
+        sizeof(VerletObject) * (uint64_t)header->count,
+        sizeof(uint32_t) * (uint64_t)header->count,
+        sizeof(uint32_t) * (uint64_t)header->numSlots,
+        sizeof(uint32_t) * (uint64_t)header->numSlots,
+        sizeof(uint32_t) * (uint64_t)header->numFree,
+    };
+    for (int s = 0; s < SNAPSHOT_STREAMS; s++) {
+        if (header->sizes[s] != expected[s] || header->offsets[s] % SNAPSHOT_ALIGN != 0
+            || header->offsets[s] + header->sizes[s] > fileSize) {
+            printf("Snapshot is truncated or corrupt\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// The handle tables must agree with each other: every particle's slot maps
+// back to it, every used slot to a particle, and every other slot is on the
+// free list exactly once
+static bool validateIndices(const SnapshotHeader* header, const char* file)
+{
+    if ((uint64_t)header->count + header->numFree != header->numSlots) {
+        printf("Snapshot has %u particles and %u free slots, not %u slots\n", header->count, header->numFree, header->numSlots);
+        return false;
+    }
+    const uint32_t* owners = (const uint32_t*)(file + header->offsets[STREAM_OWNERS]);
+    const uint32_t* dense = (const uint32_t*)(file + header->offsets[STREAM_DENSE]);
+    const uint32_t* freeSlots = (const uint32_t*)(file + header->offsets[STREAM_FREE_SLOTS]);
+    for (uint32_t i = 0; i < header->count; i++) {
+        if (owners[i] >= header->numSlots || dense[owners[i]] != i) {
+            printf("Snapshot particle %u has a bad slot\n", i);
+            return false;
+        }
+    }
+    for (uint32_t s = 0; s < header->numSlots; s++) {
+        if (dense[s] != INVALID_SLOT && (dense[s] >= header->count || owners[dense[s]] != s)) {
+            printf("Snapshot slot %u has a bad particle index\n", s);
+            return false;
+        }
+    }
+    // One bit per slot to catch a slot listed twice
+    uint8_t* listed = calloc((header->numSlots + 7) / 8, 1);
+    bool valid = true;
+    for (uint32_t f = 0; f < header->numFree && valid; f++) {
+        uint32_t slot = freeSlots[f];
+        if (slot >= header->numSlots || dense[slot] != INVALID_SLOT || (listed[slot / 8] & (1 << (slot % 8)))) {
+            printf("Snapshot free slot %u is not free or listed twice\n", f);
+            valid = false;
+        } else {
+            listed[slot / 8] |= 1 << (slot % 8);
+        }
+    }
+    free(listed);
+    return valid;
+}
+
+bool loadSnapshot(const char* path, ParticleStore* store, mfloat_t* containerPosition, unsigned long* step)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Failed to open snapshot %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(SnapshotHeader)) {
+        printf("Snapshot %s is too short\n", path);
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    const char* file = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        printf("Failed to map snapshot %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    posix_madvise((void*)file, size, POSIX_MADV_SEQUENTIAL);
+
+    const SnapshotHeader* header = (const SnapshotHeader*)file;
+    bool valid = validateHeader(header, size, store) && validateIndices(header, file);
+    if (valid) {
+        // Straight copies of the mapped streams, nothing to parse
+        void* streams[SNAPSHOT_STREAMS] = { store->objects, store->owners, store->dense, store->generations, store->freeSlots };
+        for (int s = 0; s < SNAPSHOT_STREAMS; s++) {
+            memcpy(streams[s], file + header->offsets[s], header->sizes[s]);
+        }
+        store->count = header->count;
+        store->numSlots = header->numSlots;
+        store->numFree = header->numFree;
+        vec3_assign(containerPosition, (mfloat_t*)header->containerPosition);
+        if (step) {
+            *step = header->step;
+        }
+
+        // Particles keep the color and mass they were saved with
+        for (uint32_t s = 0; s < header->numSpecies && s < SNAPSHOT_SPECIES; s++) {
+            VerletObject probe = { .color = s };
+            setMassFromColor(&probe);
+            if (probe.mass != header->species[s].mass) {
+                printf("Snapshot species %u was saved with mass %.3f, now %.3f\n", s, header->species[s].mass, probe.mass);
+            }
+        }
+    }
+    munmap((void*)file, size);
+    return valid;
+}
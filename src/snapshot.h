@@ -0,0 +1,60 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "mathc.h"
+#include "particles.h"
+
+#define SNAPSHOT_MAGIC 0x50414E53u // "SNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ALIGN 64 // Every stream starts on a cache line
+#define SNAPSHOT_SPECIES (WHITE + 1)
+
+// Raw arrays of the particle store, in file order
+enum {
+    STREAM_OBJECTS,     // count VerletObjects
+    STREAM_OWNERS,      // count uint32_t
+    STREAM_DENSE,       // numSlots uint32_t
+    STREAM_GENERATIONS, // numSlots uint32_t
+    STREAM_FREE_SLOTS,  // numFree uint32_t
+    SNAPSHOT_STREAMS
+};
+
+typedef struct {
+    mfloat_t color[VEC3_SIZE];
+    mfloat_t mass;
+} SnapshotSpecies;
+
+// The streams are the store's own memory layout, so a file only loads on a
+// build with the same VerletObject; objectSize catches most mismatches.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t objectSize;
+    uint32_t count;
+    uint32_t numSlots;
+    uint32_t numFree;
+    uint32_t numSpecies;
+    uint64_t step;
+    mfloat_t containerPosition[VEC3_SIZE];
+    mfloat_t containerRadius;
+    SnapshotSpecies species[SNAPSHOT_SPECIES];
+    uint64_t offsets[SNAPSHOT_STREAMS];
+    uint64_t sizes[SNAPSHOT_STREAMS];
+} SnapshotHeader;
+
+// Writes header and streams with one writev into a temporary file, syncs it
+// and renames it over path, then syncs the directory, so a crash or power
+// loss leaves either the old snapshot or the whole new one
+bool saveSnapshot(const char* path, const ParticleStore* store, const mfloat_t* containerPosition, unsigned long step);
+
+// Maps the file and copies the streams straight into the store. The handle
+// tables come along, so handles taken before the save still resolve to the
+// same particles. step may be NULL. Files whose handle tables point outside
+// the saved particles are rejected.
+bool loadSnapshot(const char* path, ParticleStore* store, mfloat_t* containerPosition, unsigned long* step);
+
+#endif
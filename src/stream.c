@@ -0,0 +1,126 @@
+#include "stream.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#define FENCE_TIMEOUT 1000000000 // 1 second in nanoseconds
+
+InstanceStream* createInstanceStream(int capacity)
+{
+    InstanceStream* stream = malloc(sizeof(InstanceStream));
+    stream->capacity = capacity;
+    stream->region = 0;
+    stream->mapped = NULL;
+    stream->staging = NULL;
+    for (int i = 0; i < STREAM_REGIONS; i++) {
+        stream->fences[i] = NULL;
+    }
+
+    glGenBuffers(1, &(stream->VBO));
+    glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+
+    stream->persistent = GLEW_ARB_buffer_storage;
+    if (stream->persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GLsizeiptr size = sizeof(InstanceData) * capacity * STREAM_REGIONS;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        stream->mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+        if (stream->mapped == NULL) {
+            printf("Persistent mapping failed, falling back to orphaning\n");
+            // Immutable storage cannot be respecified, start over with a fresh buffer
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glDeleteBuffers(1, &(stream->VBO));
+            glGenBuffers(1, &(stream->VBO));
+            glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+            stream->persistent = false;
+        }
+    }
+    if (!stream->persistent) {
+        glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * capacity, NULL, GL_STREAM_DRAW);
+        stream->staging = malloc(sizeof(InstanceData) * capacity);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return stream;
+}
+
+void destroyInstanceStream(InstanceStream* stream)
+{
+    for (int i = 0; i < STREAM_REGIONS; i++) {
+        if (stream->fences[i]) {
+            glDeleteSync(stream->fences[i]);
+        }
+    }
+    if (stream->mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &(stream->VBO));
+    free(stream->staging);
+    free(stream);
+}
+
+InstanceData* beginInstanceUpload(InstanceStream* stream)
+{
+    if (!stream->persistent) {
+        return stream->staging;
+    }
+
+    GLsync fence = stream->fences[stream->region];
+    if (fence) {
+        // Normally already signaled; only waits when the GPU is 3 frames behind
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        while (status == GL_TIMEOUT_EXPIRED) {
+            status = glClientWaitSync(fence, 0, FENCE_TIMEOUT);
+        }
+        glDeleteSync(fence);
+        stream->fences[stream->region] = NULL;
+    }
+    return stream->mapped + (size_t)stream->region * stream->capacity;
+}
+
+void endInstanceUpload(InstanceStream* stream, int count)
+{
+    if (stream->persistent) {
+        return; // Coherent mapping, writes are already visible
+    }
+
+    // Orphan the old storage so the driver doesn't sync with in-flight draws
+    glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * stream->capacity, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(InstanceData) * count, stream->staging);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void bindInstanceStream(InstanceStream* stream, Mesh* mesh, int first)
+{
+    size_t base = sizeof(InstanceData) * first;
+    if (stream->persistent) {
+        base += sizeof(InstanceData) * stream->region * stream->capacity;
+    }
+    GLsizei stride = sizeof(InstanceData);
+
+    glBindVertexArray(mesh->VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->VBO);
+    // Position
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, position)));
+    // Velocity
+    glVertexAttribPointer(4, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, velocity)));
+    // Color
+    glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, color)));
+    // Radius
+    glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + offsetof(InstanceData, radius)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void fenceInstanceStream(InstanceStream* stream)
+{
+    if (!stream->persistent) {
+        return;
+    }
+    stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    stream->region = (stream->region + 1) % STREAM_REGIONS;
+}
@@ -0,0 +1,41 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include <stdbool.h>
+
+#include <GL/glew.h>
+
+#include "model.h"
+
+#define STREAM_REGIONS 3
+
+// Ring of per-frame instance regions in one buffer. With ARB_buffer_storage the
+// buffer is persistently mapped and each region is guarded by a fence, so the
+// CPU fills frame N+1 while the GPU still reads frame N. Without it, a single
+// region is orphaned and re-uploaded every frame.
+typedef struct {
+    unsigned int VBO;
+    InstanceData* mapped;  // Persistent mapping of all regions, NULL when orphaning
+    InstanceData* staging; // CPU copy used by the orphaning path
+    GLsync fences[STREAM_REGIONS];
+    int capacity;          // Instances per region
+    int region;            // Region written this frame
+    bool persistent;
+} InstanceStream;
+
+InstanceStream* createInstanceStream(int capacity);
+void destroyInstanceStream(InstanceStream* stream);
+
+// Returns where this frame's instances should be written (blocks only if the GPU
+// is still reading the region from STREAM_REGIONS frames ago)
+InstanceData* beginInstanceUpload(InstanceStream* stream);
+void endInstanceUpload(InstanceStream* stream, int count);
+
+// Point the instance attributes of an instanced mesh at this frame's region,
+// starting at instance first
+void bindInstanceStream(InstanceStream* stream, Mesh* mesh, int first);
+
+// Call after the last draw reading this frame's region
+void fenceInstanceStream(InstanceStream* stream);
+
+#endif
@@ -0,0 +1,236 @@
+#include "trajectory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "varint.h"
+
+#define TRAJECTORY_RANGE (CONTAINER_RADIUS + 1.0f) // Half extent quantized around the container
+
+static int32_t quantize(mfloat_t value, mfloat_t center)
+{
+    const mfloat_t scale = ((1 << TRAJECTORY_BITS) - 1) / (2.0f * TRAJECTORY_RANGE);
+    int32_t q = (int32_t)((value - center + TRAJECTORY_RANGE) * scale + 0.5f);
+    return clampi(q, 0, (1 << TRAJECTORY_BITS) - 1);
+}
+
+static void flushChunk(TrajectoryRecorder* recorder)
+{
+    if (recorder->chunkFrames == 0) {
+        return;
+    }
+    if (recorder->numChunks == recorder->indexCapacity) {
+        recorder->indexCapacity = recorder->indexCapacity ? recorder->indexCapacity * 2 : 64;
+        recorder->index = realloc(recorder->index, sizeof(TrajectoryIndexEntry) * recorder->indexCapacity);
+    }
+    TrajectoryIndexEntry* entry = &recorder->index[recorder->numChunks++];
+    entry->offset = ftell(recorder->file);
+    entry->firstStep = recorder->chunkStep;
+    entry->numFrames = recorder->chunkFrames;
+    entry->reserved = 0;
+
+    TrajectoryChunk header = { TRAJECTORY_CHUNK_MAGIC, recorder->chunkFrames, recorder->chunkStep, recorder->chunkSize };
+    fwrite(&header, sizeof(header), 1, recorder->file);
+    fwrite(recorder->chunk, 1, recorder->chunkSize, recorder->file);
+    fflush(recorder->file);
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->encodedBytes += sizeof(header);
+    pthread_mutex_unlock(&recorder->lock);
+
+    recorder->chunkSize = 0;
+    recorder->chunkFrames = 0;
+    recorder->chunkIndex++;
+}
+
+// Appends the frame to the open chunk and returns its encoded size
+static size_t encodeFrame(TrajectoryRecorder* recorder, const TrajectoryFrame* frame)
+{
+    // Worst case: every field at its longest varint
+    size_t bound = 2 * MAX_VARINT + sizeof(frame->container) + (size_t)frame->count * (5 + 2 + 3 * 3);
+    if (recorder->chunkSize + bound > recorder->chunkCapacity) {
+        recorder->chunkCapacity = (recorder->chunkSize + bound) * 2;
+        recorder->chunk = realloc(recorder->chunk, recorder->chunkCapacity);
+    }
+    if (recorder->chunkFrames == 0) {
+        recorder->chunkStep = frame->step;
+    }
+
+    unsigned char* start = recorder->chunk + recorder->chunkSize;
+    unsigned char* out = start;
+    out = putVarint(out, frame->step);
+    out = putVarint(out, frame->count);
+    memcpy(out, frame->container, sizeof(frame->container));
+    out += sizeof(frame->container);
+
+    uint32_t previousSlot = 0;
+    for (int i = 0; i < frame->count; i++) {
+        uint32_t slot = frame->slots[i];
+        int32_t* previous = &recorder->previous[slot * 3];
+        // Particles new to this chunk (or to a reused slot) have nothing to
+        // delta against, which keeps every chunk decodable on its own
+        bool key = recorder->chunks[slot] != recorder->chunkIndex || recorder->generations[slot] != frame->generations[i];
+        if (key) {
+            previous[0] = previous[1] = previous[2] = 0;
+            recorder->chunks[slot] = recorder->chunkIndex;
+            recorder->generations[slot] = frame->generations[i];
+        }
+        out = putVarint(out, zigzag((int64_t)slot - previousSlot) << 1 | key);
+        if (key) {
+            out = putVarint(out, frame->species[i]);
+        }
+        previousSlot = slot;
+
+        const mfloat_t* p = &frame->positions[i * VEC3_SIZE];
+        for (int a = 0; a < 3; a++) {
+            int32_t q = quantize(p[a], frame->container[a]);
+            out = putVarint(out, zigzag(q - previous[a]));
+            previous[a] = q;
+        }
+    }
+    recorder->chunkSize = out - recorder->chunk;
+
+    if (++recorder->chunkFrames == TRAJECTORY_CHUNK) {
+        flushChunk(recorder);
+    }
+    return out - start;
+}
+
+static void* writerLoop(void* arg)
+{
+    TrajectoryRecorder* recorder = arg;
+
+    pthread_mutex_lock(&recorder->lock);
+    for (;;) {
+        while (recorder->count == 0 && !recorder->stopping) {
+            pthread_cond_wait(&recorder->filled, &recorder->lock);
+        }
+        if (recorder->count == 0) {
+            break;
+        }
+        // The slot stays owned by the writer until count drops
+        TrajectoryFrame* frame = &recorder->queue[recorder->head];
+        pthread_mutex_unlock(&recorder->lock);
+
+        size_t bytes = encodeFrame(recorder, frame);
+
+        pthread_mutex_lock(&recorder->lock);
+        recorder->encodedBytes += bytes;
+        recorder->rawBytes += sizeof(mfloat_t) * VEC3_SIZE * frame->count;
+        recorder->frames++;
+        recorder->head = (recorder->head + 1) % TRAJECTORY_QUEUE;
+        recorder->count--;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+
+    flushChunk(recorder);
+
+    // Index for random access, found through the footer at the very end
+    TrajectoryFooter footer = { TRAJECTORY_INDEX_MAGIC, recorder->numChunks, ftell(recorder->file) };
+    fwrite(recorder->index, sizeof(TrajectoryIndexEntry), recorder->numChunks, recorder->file);
+    fwrite(&footer, sizeof(footer), 1, recorder->file);
+    return NULL;
+}
+
+TrajectoryRecorder* createTrajectoryRecorder(const char* path, int capacity)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Couldn't open file %s\n", path);
+        return NULL;
+    }
+    TrajectoryHeader header = { TRAJECTORY_MAGIC, TRAJECTORY_VERSION, TRAJECTORY_BITS, TRAJECTORY_CHUNK, TRAJECTORY_RANGE, 0 };
+    fwrite(&header, sizeof(header), 1, file);
+
+    TrajectoryRecorder* recorder = malloc(sizeof(TrajectoryRecorder));
+    memset(recorder, 0, sizeof(TrajectoryRecorder));
+    recorder->file = file;
+    recorder->capacity = capacity;
+    recorder->encodedBytes = sizeof(header);
+    for (int i = 0; i < TRAJECTORY_QUEUE; i++) {
+        TrajectoryFrame* frame = &recorder->queue[i];
+        frame->positions = malloc(sizeof(mfloat_t) * VEC3_SIZE * capacity);
+        frame->slots = malloc(sizeof(uint32_t) * capacity);
+        frame->generations = malloc(sizeof(uint32_t) * capacity);
+        frame->species = malloc(sizeof(uint8_t) * capacity);
+    }
+    recorder->previous = calloc((size_t)capacity * 3, sizeof(int32_t));
+    recorder->generations = calloc(capacity, sizeof(uint32_t));
+    recorder->chunks = calloc(capacity, sizeof(uint32_t));
+    recorder->chunkIndex = 1; // Every slot starts out unseen
+
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->filled, NULL);
+    pthread_create(&recorder->writer, NULL, writerLoop, recorder);
+    return recorder;
+}
+
+void destroyTrajectoryRecorder(TrajectoryRecorder* recorder)
+{
+    pthread_mutex_lock(&recorder->lock);
+    recorder->stopping = true;
+    pthread_cond_signal(&recorder->filled);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->writer, NULL);
+    fclose(recorder->file);
+
+    TrajectoryStats stats;
+    getTrajectoryStats(recorder, &stats);
+    printf("Trajectory: %lu frames, %.1fx smaller than raw, %d dropped\n", stats.frames, stats.ratio, stats.dropped);
+
+    for (int i = 0; i < TRAJECTORY_QUEUE; i++) {
+        free(recorder->queue[i].positions);
+        free(recorder->queue[i].slots);
+        free(recorder->queue[i].generations);
+        free(recorder->queue[i].species);
+    }
+    free(recorder->previous);
+    free(recorder->generations);
+    free(recorder->chunks);
+    free(recorder->chunk);
+    free(recorder->index);
+    pthread_cond_destroy(&recorder->filled);
+    pthread_mutex_destroy(&recorder->lock);
+    free(recorder);
+}
+
+bool recordTrajectory(TrajectoryRecorder* recorder, const ParticleStore* store, const mfloat_t* containerPosition, unsigned long step)
+{
+    pthread_mutex_lock(&recorder->lock);
+    bool full = recorder->count == TRAJECTORY_QUEUE || store->numSlots > recorder->capacity;
+    if (full) {
+        recorder->dropped++;
+        pthread_mutex_unlock(&recorder->lock);
+        return false;
+    }
+    TrajectoryFrame* frame = &recorder->queue[(recorder->head + recorder->count) % TRAJECTORY_QUEUE];
+    pthread_mutex_unlock(&recorder->lock);
+
+    // The writer never touches slots past head + count
+    for (int i = 0; i < store->count; i++) {
+        uint32_t slot = store->owners[i];
+        vec3_assign(&frame->positions[i * VEC3_SIZE], store->objects[i].current);
+        frame->slots[i] = slot;
+        frame->generations[i] = store->generations[slot];
+        frame->species[i] = store->objects[i].color;
+    }
+    frame->count = store->count;
+    frame->step = step;
+    vec3_assign(frame->container, (mfloat_t*)containerPosition);
+
+    pthread_mutex_lock(&recorder->lock);
+    recorder->count++;
+    pthread_cond_signal(&recorder->filled);
+    pthread_mutex_unlock(&recorder->lock);
+    return true;
+}
+
+void getTrajectoryStats(TrajectoryRecorder* recorder, TrajectoryStats* stats)
+{
+    pthread_mutex_lock(&recorder->lock);
+    stats->ratio = recorder->encodedBytes > 0 ? (float)recorder->rawBytes / recorder->encodedBytes : 0.0f;
+    stats->backlog = recorder->count;
+    stats->dropped = recorder->dropped;
+    stats->frames = recorder->frames;
+    pthread_mutex_unlock(&recorder->lock);
+}
@@ -0,0 +1,123 @@
+#ifndef __TRAJECTORY_H__
+#define __TRAJECTORY_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "mathc.h"
+#include "particles.h"
+
+#define TRAJECTORY_MAGIC 0x4A415254u       // "TRAJ"
+#define TRAJECTORY_CHUNK_MAGIC 0x4B4E4843u // "CHNK"
+#define TRAJECTORY_INDEX_MAGIC 0x58444E49u // "INDX"
+#define TRAJECTORY_VERSION 2
+#define TRAJECTORY_BITS 16    // Quantization per axis
+#define TRAJECTORY_CHUNK 64   // Frames per chunk; each chunk opens with a keyframe
+#define TRAJECTORY_QUEUE 16   // Frames buffered for the writer thread
+
+// File layout: a TrajectoryHeader, then chunks of a TrajectoryChunk header
+// followed by bytes of encoded frames, then an index of every chunk and a
+// TrajectoryFooter as the last bytes. A frame is
+//   varint step, varint count, float container[3],
+//   count x { varint (zigzag(slot - previous slot) << 1 | key), [varint species if key],
+//             3 x varint zigzag(delta) }
+// where each delta is against the same slot's quantized position the last
+// time it appeared in this chunk, or against 0 when key is set. Positions are
+// quantized to TRAJECTORY_BITS over [-range, range] around that frame's container.
+// A recording cut short has no index; its chunks can still be walked in order.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t bits;
+    uint32_t chunkFrames;
+    float range;
+    uint32_t reserved;
+} TrajectoryHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t numFrames;
+    uint64_t firstStep;
+    uint64_t bytes; // Encoded frames following this header
+} TrajectoryChunk;
+
+typedef struct {
+    uint64_t offset; // Of the TrajectoryChunk header
+    uint64_t firstStep;
+    uint32_t numFrames;
+    uint32_t reserved;
+} TrajectoryIndexEntry;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t numChunks;
+    uint64_t indexOffset;
+} TrajectoryFooter;
+
+// One step as copied off the simulation thread
+typedef struct {
+    mfloat_t* positions; // VEC3_SIZE per particle
+    uint32_t* slots;
+    uint32_t* generations;
+    uint8_t* species;
+    int count;
+    uint64_t step;
+    mfloat_t container[VEC3_SIZE];
+} TrajectoryFrame;
+
+typedef struct {
+    float ratio;   // Raw float bytes over encoded bytes
+    int backlog;   // Frames waiting for the writer
+    int dropped;   // Frames skipped because the queue was full
+    unsigned long frames;
+} TrajectoryStats;
+
+// Appends simulation steps to a file. The caller only copies positions into
+// a free queue slot; quantizing, delta and varint coding and all I/O happen on
+// a background writer thread. A full queue drops the frame, it never waits.
+typedef struct {
+    FILE* file;
+    int capacity;
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t filled; // Writer has work or should stop
+    TrajectoryFrame queue[TRAJECTORY_QUEUE];
+    int head;
+    int count;
+    bool stopping;
+
+    // Writer thread only
+    int32_t* previous;        // slot -> quantized position when last encoded
+    uint32_t* generations;    // slot -> generation when last encoded
+    uint32_t* chunks;         // slot -> chunk it was last encoded in
+    uint32_t chunkIndex;
+    unsigned char* chunk;     // Encoded frames of the open chunk
+    size_t chunkSize;
+    size_t chunkCapacity;
+    int chunkFrames;
+    uint64_t chunkStep;
+    TrajectoryIndexEntry* index;
+    int numChunks;
+    int indexCapacity;
+
+    // Guarded by lock
+    uint64_t rawBytes;
+    uint64_t encodedBytes;
+    unsigned long frames;
+    int dropped;
+} TrajectoryRecorder;
+
+// capacity is the largest particle count and slot number that will be recorded
+TrajectoryRecorder* createTrajectoryRecorder(const char* path, int capacity);
+// Writes every queued frame and the index, closes the file and prints a summary
+void destroyTrajectoryRecorder(TrajectoryRecorder* recorder);
+
+// Queue the store's current positions. Returns false when the frame was dropped.
+bool recordTrajectory(TrajectoryRecorder* recorder, const ParticleStore* store, const mfloat_t* containerPosition, unsigned long step);
+
+void getTrajectoryStats(TrajectoryRecorder* recorder, TrajectoryStats* stats);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __VARINT_H__
+#define __VARINT_H__
+
+#include <stdint.h>
+
+#define MAX_VARINT 10 // Bytes in the longest 64-bit varint
+
+// LEB128: seven bits per byte, high bit set on every byte but the last
+static inline unsigned char* putVarint(unsigned char* out, uint64_t value)
+{
+    while (value >= 0x80) {
+        *out++ = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (unsigned char)value;
+    return out;
+}
+
+static inline const unsigned char* getVarint(const unsigned char* in, uint64_t* value)
+{
+    uint64_t result = 0;
+    int shift = 0;
+    while (*in & 0x80) {
+        result |= (uint64_t)(*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    *value = result | (uint64_t)*in++ << shift;
+    return in;
+}
+
+// As getVarint, for untrusted input: NULL instead of reading at or past end,
+// or past MAX_VARINT bytes
+static inline const unsigned char* getVarintBounded(const unsigned char* in, const unsigned char* end, uint64_t* value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; in < end && shift < 7 * MAX_VARINT; shift += 7) {
+        result |= (uint64_t)(*in & 0x7F) << shift;
+        if (!(*in++ & 0x80)) {
+            *value = result;
+            return in;
+        }
+    }
+    return NULL;
+}
+
+// Small magnitudes of either sign become small unsigned values
+static inline uint64_t zigzag(int64_t value)
+{
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value)
+{
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+#endif
@@ -1,12 +1,13 @@
 #include "verlet.h"
+#include "workers.h"
+#include "profiler.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
 
 #define GRAVITY -9.8f
-#define THREAD_COUNT 8
+#define COLLISION_SLABS (2 * THREAD_COUNT) // Two slabs per worker, alternated so neighbours never run together
 
 
 // Implementation of setColorVector
@@ -16,37 +17,31 @@ void setColorVector(VerletObject* obj) {
             obj->colorVector[0] = 1.0f;
             obj->colorVector[1] = 0.0f;
             obj->colorVector[2] = 0.0f;
-            obj->visible = true;
             break;
         case GREEN:
             obj->colorVector[0] = 0.0f;
             obj->colorVector[1] = 1.0f;
             obj->colorVector[2] = 0.0f;
-            obj->visible = true;
             break;
         case BLUE:
             obj->colorVector[0] = 0.0f;
             obj->colorVector[1] = 0.0f;
             obj->colorVector[2] = 1.0f;
-            obj->visible = true;
             break;
         case WHITE:
             obj->colorVector[0] = 1.0f;
             obj->colorVector[1] = 1.0f;
             obj->colorVector[2] = 1.0f;
-            obj->visible = true;
             break;
         //case INVISIBLE:
         //    obj->colorVector[0] = 1.0f; // default to white
         //    obj->colorVector[1] = 1.0f;
         //    obj->colorVector[2] = 1.0f;
-        //    obj->visible = false;
         // Add more colors as needed
         default:
             obj->colorVector[0] = 1.0f; // default to white
             obj->colorVector[1] = 1.0f;
             obj->colorVector[2] = 1.0f;
-            obj->visible = true;
             break;
     }
 }
@@ -145,7 +140,6 @@ void applyCollisions(VerletObject* objects, int size)
     }
 }
 
-#define DIMENSION 58 // CONTAINER_RADIUS / VERLET_RADIUS + 5
 // Commenting this out to use linked list instead of fixed-size array
 //#define MAX_PER_CELL 4
 //VerletObject* grid[DIMENSION][DIMENSION][DIMENSION][MAX_PER_CELL];
@@ -178,13 +172,17 @@ void fillGrid(VerletObject* objects, int size)
 {
     for (int i = 0; i < size; i++) {
         VerletObject* obj = &(objects[i]);
-        int gridX = obj->current[0] / (VERLET_RADIUS * 2) + DIMENSION / 2;
-        int gridY = obj->current[1] / (VERLET_RADIUS * 2) + DIMENSION / 2;
-        int gridZ = obj->current[2] / (VERLET_RADIUS * 2) + DIMENSION / 2;
-        gridX = clampi(gridX, 0, DIMENSION - 1);
-        gridY = clampi(gridY, 0, DIMENSION - 1);
-        gridZ = clampi(gridZ, 0, DIMENSION - 1);
-        pushNode(gridX, gridY, gridZ, obj);
+        int cell[3];
+        gridCoordinates(obj->current, cell);
+        pushNode(cell[0], cell[1], cell[2], obj);
+    }
+}
+
+void gridCoordinates(const mfloat_t* position, int* cell)
+{
+    for (int a = 0; a < 3; a++) {
+        int c = position[a] / GRID_CELL + DIMENSION / 2;
+        cell[a] = clampi(c, 0, DIMENSION - 1);
     }
 }
 
@@ -204,19 +202,14 @@ void clearGrid()
         }
     }
 }
-void* threadFunction(void* arg)
+void collideSlab(int thread_id, void* arg)
 {
-    int thread_id = *((int*)arg);
-    int start = 1 + thread_id * ((DIMENSION) / THREAD_COUNT);
-    int end = 1 + (thread_id + 1) * ((DIMENSION) / THREAD_COUNT);
-
-    // Handle remaining iterations for the last thread
-    if (thread_id == THREAD_COUNT - 1) {
-        end += DIMENSION % THREAD_COUNT - 2;
-    }
-
-    // printf("%d :: %d -> %d\n", thread_id, start, end);
+    // Slab 2 * thread_id + phase of COLLISION_SLABS across the inner columns
+    int slab = 2 * thread_id + *(int*)arg;
+    int start = 1 + slab * (DIMENSION - 2) / COLLISION_SLABS;
+    int end = 1 + (slab + 1) * (DIMENSION - 2) / COLLISION_SLABS;
 
+    PROFILE_BEGIN(PROFILE_WORKERS + thread_id, PROFILE_COLLISIONS);
     for (int x = start; x < end; x++) {
         for (int y = 1; y < DIMENSION - 1; y++) {
             for (int z = 1; z < DIMENSION - 1; z++) {
@@ -237,24 +230,24 @@ void* threadFunction(void* arg)
             }
         }
     }
-    return NULL;
+    PROFILE_END(PROFILE_WORKERS + thread_id, PROFILE_COLLISIONS);
 }
 
-pthread_t threads[THREAD_COUNT];
-int thread_ids[THREAD_COUNT];
-
 void applyGridCollisions(VerletObject* objects, int size)
 {
     clearGrid();
     fillGrid(objects, size);
-    // Start the threads
-    for (int t = 0; t < THREAD_COUNT; t++) {
-        thread_ids[t] = t;
-        pthread_create(&threads[t], NULL, threadFunction, (void*)&thread_ids[t]);
-    }
-    // Wait for threads to finish
-    for (int t = 0; t < THREAD_COUNT; t++) {
-        pthread_join(threads[t], NULL);
+    resolveGridCollisions();
+}
+
+void resolveGridCollisions()
+{
+    // Each worker of the pool resolves one x-slab of the grid. A slab also
+    // moves particles in the columns either side of it, so the even slabs run
+    // first and the odd ones after: slabs running together never share a
+    // particle, and a step gives the same result every time.
+    for (int phase = 0; phase < 2; phase++) {
+        runWorkers(collideSlab, &phase);
     }
 }
 
@@ -356,7 +349,7 @@ void addForce(VerletObject* objects, int size, mfloat_t* center, float strength)
     }
 }
 
-void resetObjects(VerletObject* objects, int size, mfloat_t* initialPosition, mfloat_t* initialVelocity, float radius, ParticleColor color, bool visible)
+void resetObjects(VerletObject* objects, int size, mfloat_t* initialPosition, mfloat_t* initialVelocity, float radius, ParticleColor color)
 {
     for (int i = 0; i < size; i++) {
         VerletObject* obj = &objects[i];
@@ -371,10 +364,10 @@ void resetObjects(VerletObject* objects, int size, mfloat_t* initialPosition, mf
         // Set other properties
         obj->radius = radius;
         obj->color = color;
-        setColorVector(obj); // sets colorVector and visible
-        obj->visible = visible; // override if needed
+        setColorVector(obj);
         vec3_zero(obj->acceleration);
         // Initialize mass based on color
         setMassFromColor(obj);
+        obj->lifetime = 0;
     }
 }
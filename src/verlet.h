@@ -27,9 +27,10 @@ typedef struct {
     mfloat_t radius;
     ParticleColor color;
     mfloat_t colorVector[VEC3_SIZE]; // Add a color vector to store RGB values
-    bool visible;
     // Mass of the particle (depends on color)
     mfloat_t mass;
+    // Seconds left to live, 0 for immortal
+    mfloat_t lifetime;
 } VerletObject;
 
 struct NodeStruct {
@@ -38,6 +39,11 @@ struct NodeStruct {
 };
 typedef struct NodeStruct Node;
 
+// Uniform collision grid, one particle diameter per cell, centered on the origin
+#define DIMENSION 58 // CONTAINER_RADIUS / VERLET_RADIUS + 5
+#define GRID_CELL (VERLET_RADIUS * 2)
+extern Node* grid[DIMENSION][DIMENSION][DIMENSION];
+
 
 void setColorVector(VerletObject* obj);
 // Initialize mass based on the particle color
@@ -49,6 +55,11 @@ void updatePositions(VerletObject* objects, int size, float dt);
 
 void clearGrid();
 void fillGrid(VerletObject* objects, int size);
+// Cell holding position, clamped to the grid like fillGrid does
+void gridCoordinates(const mfloat_t* position, int* cell);
+// Resolve every collision between particles in neighbouring cells of the filled grid
+void resolveGridCollisions();
+// clearGrid, fillGrid, then resolveGridCollisions
 void applyGridCollisions(VerletObject* objects, int size);
 
 void addForce(VerletObject* objects, int size, mfloat_t* center, float strength);
@@ -0,0 +1,105 @@
+#include "workers.h"
+
+#include <stdbool.h>
+#include <pthread.h>
+
+static pthread_t threads[THREAD_COUNT];
+static int thread_ids[THREAD_COUNT];
+static bool started = false;
+static bool stopping = false;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+// Held for a whole job, so the sim and render threads take turns on the pool
+static pthread_mutex_t submit = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+// Current job, published under lock and identified by its generation
+static WorkerTask currentTask;
+static void* currentArg;
+static unsigned long generation = 0;
+static int pending = 0;
+
+static void* workerLoop(void* arg)
+{
+    int worker = *((int*)arg);
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        while (generation == seen && !stopping) {
+            pthread_cond_wait(&wake, &lock);
+        }
+        if (stopping) {
+            break;
+        }
+        seen = generation;
+        WorkerTask task = currentTask;
+        void* taskArg = currentArg;
+        pthread_mutex_unlock(&lock);
+
+        task(worker, taskArg);
+
+        pthread_mutex_lock(&lock);
+        if (--pending == 0) {
+            pthread_cond_signal(&done);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+void runWorkers(WorkerTask task, void* arg)
+{
+    pthread_mutex_lock(&submit);
+    if (!started) {
+        // Worker 0 is the caller, only spawn the helpers
+        for (int t = 1; t < THREAD_COUNT; t++) {
+            thread_ids[t] = t;
+            pthread_create(&threads[t], NULL, workerLoop, (void*)&thread_ids[t]);
+        }
+        started = true;
+    }
+
+    pthread_mutex_lock(&lock);
+    currentTask = task;
+    currentArg = arg;
+    pending = THREAD_COUNT - 1;
+    generation++;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+
+    task(0, arg);
+
+    pthread_mutex_lock(&lock);
+    while (pending > 0) {
+        pthread_cond_wait(&done, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    pthread_mutex_unlock(&submit);
+}
+
+void stopWorkers()
+{
+    pthread_mutex_lock(&submit);
+    if (!started) {
+        pthread_mutex_unlock(&submit);
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&wake);
+    pthread_mutex_unlock(&lock);
+    for (int t = 1; t < THREAD_COUNT; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    started = false;
+    stopping = false;
+    pthread_mutex_unlock(&submit);
+}
+
+void workerRange(int worker, int size, int* start, int* end)
+{
+    *start = (int)((long)size * worker / THREAD_COUNT);
+    *end = (int)((long)size * (worker + 1) / THREAD_COUNT);
+}
@@ -0,0 +1,19 @@
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#define THREAD_COUNT 8
+
+// Task run once per worker; worker is in [0, THREAD_COUNT)
+typedef void (*WorkerTask)(int worker, void* arg);
+
+// Run task on every worker of the persistent pool and wait for all of them.
+// The calling thread acts as worker 0. The pool is started on first use.
+// Jobs submitted from different threads run one after the other.
+void runWorkers(WorkerTask task, void* arg);
+
+void stopWorkers();
+
+// Split [0, size) into THREAD_COUNT contiguous chunks
+void workerRange(int worker, int size, int* start, int* end);
+
+#endif